@@ -20,10 +20,11 @@
 */
 
 #include "coastline_polygons.hpp"
+#include "geos_geometry.hpp"
 #include "output_database.hpp"
 #include "srs.hpp"
-#include "util.hpp"
 
+#include <geos_c.h>
 #include <ogr_geometry.h>
 
 class OGRSpatialReference;
@@ -31,14 +32,16 @@ class OGRSpatialReference;
 #include <cassert>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <utility>
+#include <vector>
 
 extern SRS srs;
 extern bool debug;
 
 namespace {
 
-std::unique_ptr<OGRPolygon> create_rectangular_polygon(double x1, double y1, double x2, double y2, double expand) {
+geos_geometry_ptr create_rectangular_polygon(double x1, double y1, double x2, double y2, double expand) {
     OGREnvelope e;
 
     e.MinX = x1 - expand;
@@ -49,18 +52,12 @@ std::unique_ptr<OGRPolygon> create_rectangular_polygon(double x1, double y1, dou
     // make sure we are inside the bounds for the output SRS
     e.Intersect(srs.max_extent());
 
-    auto ring = std::make_unique<OGRLinearRing>();
-    ring->addPoint(e.MinX, e.MinY);
-    ring->addPoint(e.MinX, e.MaxY);
-    ring->addPoint(e.MaxX, e.MaxY);
-    ring->addPoint(e.MaxX, e.MinY);
-    ring->closeRings();
-
-    auto polygon = std::make_unique<OGRPolygon>();
-    polygon->addRingDirectly(ring.release());
-    polygon->assignSpatialReference(srs.out());
+    return geos_rectangle(e);
+}
 
-    return polygon;
+bool is_polygonal(const GEOSGeometry* geometry) {
+    const int type = GEOSGeomTypeId_r(geos_context(), geometry);
+    return type == GEOS_POLYGON || type == GEOS_MULTIPOLYGON;
 }
 
 bool add_segment_to_line(OGRLineString* line, OGRPoint* point1, OGRPoint* point2) {
@@ -114,29 +111,53 @@ unsigned int CoastlinePolygons::fix_direction() {
 }
 
 void CoastlinePolygons::transform() {
-    for (const auto& polygon : m_polygons) {
+    for (auto& polygon : m_polygons) {
         srs.transform(polygon.get());
+        polygon.valid = validity::unknown;
     }
 }
 
-void CoastlinePolygons::split_geometry(std::unique_ptr<OGRGeometry>&& geom, int level) {
-    if (geom->getGeometryType() == wkbPolygon) {
-        geom->assignSpatialReference(srs.out());
-        split_polygon(static_cast_unique_ptr<OGRPolygon>(std::move(geom)), level);
-    } else if (geom->getGeometryType() == wkbMultiPolygon) {
-        const auto mp = static_cast_unique_ptr<OGRMultiPolygon>(std::move(geom));
-        while (mp->getNumGeometries() > 0) {
-            std::unique_ptr<OGRPolygon> polygon{mp->getGeometryRef(0)};
-            mp->removeGeometry(0, false);
-            polygon->assignSpatialReference(srs.out());
-            split_polygon(std::move(polygon), level);
+void CoastlinePolygons::convert_to_geos() {
+    if (m_in_geos) {
+        return;
+    }
+
+    m_geos_polygons.reserve(m_polygons.size());
+    for (auto& polygon : m_polygons) {
+        m_geos_polygons.push_back(geos_polygon{to_geos(polygon.get()), polygon.valid});
+        polygon.polygon.reset();
+    }
+    m_polygons.clear();
+    m_in_geos = true;
+}
+
+void CoastlinePolygons::split_geometry(geos_geometry_ptr&& geom, int level) {
+    GEOSContextHandle_t context = geos_context();
+    const int type = GEOSGeomTypeId_r(context, geom.get());
+    if (type == GEOS_POLYGON) {
+        split_polygon(geos_polygon{std::move(geom), validity::unknown}, level);
+    } else if (type == GEOS_MULTIPOLYGON) {
+        // Copy the parts, so the multipolygon can be freed before going
+        // down the recursion.
+        std::vector<geos_geometry_ptr> polygons;
+        const int num = GEOSGetNumGeometries_r(context, geom.get());
+        polygons.reserve(num);
+        for (int i = 0; i < num; ++i) {
+            polygons.emplace_back(GEOSGeom_clone_r(context, GEOSGetGeometryN_r(context, geom.get(), i)));
+            if (!polygons.back()) {
+                throw std::runtime_error{"Copying GEOS geometry failed"};
+            }
+        }
+        geom.reset();
+        for (auto& polygon : polygons) {
+            split_polygon(geos_polygon{std::move(polygon), validity::unknown}, level);
         }
     } else {
         assert(false);
     }
 }
 
-std::pair<std::unique_ptr<OGRPolygon>, std::unique_ptr<OGRPolygon>> CoastlinePolygons::split_envelope(const OGREnvelope& envelope, int level, int num_points) const {
+std::pair<geos_geometry_ptr, geos_geometry_ptr> CoastlinePolygons::split_envelope(const OGREnvelope& envelope, int level, int num_points) const {
     if (debug) {
         std::cerr << "DEBUG: split_polygon(): depth="
                   << level
@@ -150,7 +171,7 @@ std::pair<std::unique_ptr<OGRPolygon>, std::unique_ptr<OGRPolygon>> CoastlinePol
     }
 
     // These polygons will contain the bounding box of each half of the "polygon" polygon.
-    std::pair<std::unique_ptr<OGRPolygon>, std::unique_ptr<OGRPolygon>> envelopes;
+    std::pair<geos_geometry_ptr, geos_geometry_ptr> envelopes;
 
     if (envelope.MaxX - envelope.MinX < envelope.MaxY-envelope.MinY) {
         if (m_expand >= (envelope.MaxY - envelope.MinY) / 4) {
@@ -179,34 +200,34 @@ std::pair<std::unique_ptr<OGRPolygon>, std::unique_ptr<OGRPolygon>> CoastlinePol
     return envelopes;
 }
 
-void CoastlinePolygons::split_polygon(std::unique_ptr<OGRPolygon>&& polygon, int level) {
+void CoastlinePolygons::split_polygon(geos_polygon&& polygon, int level) {
     if (level > m_max_split_depth) {
         m_max_split_depth = level;
     }
 
-    const int num_points = polygon->getExteriorRing()->getNumPoints();
+    const int num_points = geos_num_outer_points(polygon.geometry.get());
     if (num_points <= m_max_points_in_polygon) {
         // do not split the polygon if it is small enough
-        m_polygons.push_back(std::move(polygon));
+        m_geos_polygons.push_back(std::move(polygon));
         return;
     }
 
-    OGREnvelope envelope;
-    polygon->getEnvelope(&envelope);
+    const OGREnvelope envelope = geos_envelope(polygon.geometry.get());
 
     auto const split_envelopes = split_envelope(envelope, level, num_points);
     if (!split_envelopes.first) {
-        m_polygons.push_back(std::move(polygon));
+        m_geos_polygons.push_back(std::move(polygon));
         return;
     }
 
     // Use intersection with bbox polygons to split polygon into two halfes
-    std::unique_ptr<OGRGeometry> geom1{polygon->Intersection(split_envelopes.first.get())};
-    std::unique_ptr<OGRGeometry> geom2{polygon->Intersection(split_envelopes.second.get())};
+    GEOSContextHandle_t context = geos_context();
+    geos_geometry_ptr geom1{GEOSIntersection_r(context, polygon.geometry.get(), split_envelopes.first.get())};
+    geos_geometry_ptr geom2{GEOSIntersection_r(context, polygon.geometry.get(), split_envelopes.second.get())};
 
-    if (geom1 && (geom1->getGeometryType() == wkbPolygon || geom1->getGeometryType() == wkbMultiPolygon) &&
-        geom2 && (geom2->getGeometryType() == wkbPolygon || geom2->getGeometryType() == wkbMultiPolygon)) {
+    if (geom1 && is_polygonal(geom1.get()) && geom2 && is_polygonal(geom2.get())) {
         // split was successful, go on recursively
+        polygon.geometry.reset();
         split_geometry(std::move(geom1), level + 1);
         split_geometry(std::move(geom2), level + 1);
         return;
@@ -214,45 +235,46 @@ void CoastlinePolygons::split_polygon(std::unique_ptr<OGRPolygon>&& polygon, int
 
     // split was not successful, output some debugging info and keep polygon before split
     std::cerr << "Polygon split at depth " << level << " was not successful. Keeping un-split polygon.\n";
-    m_polygons.push_back(std::move(polygon));
+    m_geos_polygons.push_back(std::move(polygon));
     if (debug) {
         std::cerr << "DEBUG geom1=" << geom1.get() << " geom2=" << geom2.get() << "\n";
         if (geom1) {
-            std::cerr << "DEBUG geom1 type=" << geom1->getGeometryName() << "\n";
-            if (geom1->getGeometryType() == wkbGeometryCollection) {
-                std::cerr << "DEBUG   numGeometries=" << static_cast<OGRGeometryCollection*>(geom1.get())->getNumGeometries() << "\n";
+            std::cerr << "DEBUG geom1 type=" << geos_type_name(geom1.get()) << "\n";
+            if (GEOSGeomTypeId_r(context, geom1.get()) == GEOS_GEOMETRYCOLLECTION) {
+                std::cerr << "DEBUG   numGeometries=" << GEOSGetNumGeometries_r(context, geom1.get()) << "\n";
             }
         }
         if (geom2) {
-            std::cerr << "DEBUG geom2 type=" << geom2->getGeometryName() << "\n";
-            if (geom2->getGeometryType() == wkbGeometryCollection) {
-                std::cerr << "DEBUG   numGeometries=" << static_cast<OGRGeometryCollection*>(geom2.get())->getNumGeometries() << "\n";
+            std::cerr << "DEBUG geom2 type=" << geos_type_name(geom2.get()) << "\n";
+            if (GEOSGeomTypeId_r(context, geom2.get()) == GEOS_GEOMETRYCOLLECTION) {
+                std::cerr << "DEBUG   numGeometries=" << GEOSGetNumGeometries_r(context, geom2.get()) << "\n";
             }
         }
     }
 }
 
 void CoastlinePolygons::split() {
-    polygon_vector_type v;
+    convert_to_geos();
+
+    geos_polygon_vector_type v;
     using std::swap;
-    swap(v, m_polygons);
-    m_polygons.reserve(v.size());
+    swap(v, m_geos_polygons);
+    m_geos_polygons.reserve(v.size());
     for (auto& polygon : v) {
         split_polygon(std::move(polygon), 0);
     }
 }
 
-void CoastlinePolygons::output_land_polygons(bool make_copy) {
-    if (make_copy) {
-        // because adding to a layer destroys the geometry, we need to copy it if it is needed later
-        for (const auto& polygon : m_polygons) {
-            m_output.add_land_polygon(make_unique_ptr_clone<OGRPolygon>(polygon.get()));
-        }
-    } else {
-        for (auto& polygon : m_polygons) {
-            m_output.add_land_polygon(std::move(polygon));
-        }
-        m_polygons.clear();
+void CoastlinePolygons::output_land_polygons(bool keep) {
+    convert_to_geos();
+
+    // The output database makes its own OGR geometries from the GEOS
+    // geometries, so they don't have to be copied if they are needed later.
+    for (const auto& polygon : m_geos_polygons) {
+        m_output.add_land_polygon(polygon.geometry.get());
+    }
+    if (!keep) {
+        m_geos_polygons.clear();
     }
 }
 
@@ -313,51 +335,52 @@ void CoastlinePolygons::output_lines(int max_points) const {
 // Without this check there will be a very narrow sliver of water at the
 // antimeridian "cutting" into Antarctica. If this returns true, the geometry
 // is the polygon with this sliver and we don't add it to the output.
-bool CoastlinePolygons::antarctica_bogus(const OGRGeometry* geom) noexcept {
-    OGREnvelope envelope;
-    geom->getEnvelope(&envelope);
+bool CoastlinePolygons::antarctica_bogus(const OGREnvelope& envelope) const noexcept {
     return m_env_east.Contains(envelope) || m_env_west.Contains(envelope);
 }
 
-void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_type&& v) {
+void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, std::vector<const GEOSGeometry*>&& v) {
 //    std::cerr << "envelope = (" << envelope.MinX << ", " << envelope.MinY
 //              << "), (" << envelope.MaxX << ", " << envelope.MaxY
 //              << ") v.size()=" << v.size() << "\n";
     if (v.size() < 100) {
         try {
-            std::unique_ptr<OGRGeometry> geom{create_rectangular_polygon(envelope.MinX, envelope.MinY, envelope.MaxX, envelope.MaxY, m_expand)};
-            assert(geom->getSpatialReference() != nullptr);
-            for (const auto& polygon : v) {
-                std::unique_ptr<OGRGeometry> diff{geom->Difference(polygon.get())};
-                assert(diff);
-                // for some reason there is sometimes no srs on the geometries, so we add them on
-                diff->assignSpatialReference(srs.out());
+            GEOSContextHandle_t context = geos_context();
+            const geos_geometry_ptr rectangle = create_rectangular_polygon(envelope.MinX, envelope.MinY, envelope.MaxX, envelope.MaxY, m_expand);
+
+            // Polygons not intersecting the rectangle can't change the
+            // result, the prepared rectangle finds those faster than the
+            // Difference() would.
+            const geos_prepared_ptr prepared{GEOSPrepare_r(context, rectangle.get())};
+
+            geos_geometry_ptr geom{GEOSGeom_clone_r(context, rectangle.get())};
+            for (const auto* polygon : v) {
+                if (prepared && GEOSPreparedIntersects_r(context, prepared.get(), polygon) == 0) {
+                    continue;
+                }
+                geos_geometry_ptr diff{GEOSDifference_r(context, geom.get(), polygon)};
+                if (!diff) {
+                    throw std::runtime_error{"GEOS Difference failed"};
+                }
                 geom = std::move(diff);
             }
             if (geom) {
-                switch (geom->getGeometryType()) {
-                    case wkbPolygon:
-                        if (!antarctica_bogus(geom.get())) {
-                            auto polygon = static_cast_unique_ptr<OGRPolygon>(std::move(geom));
-                            if (polygon->getExteriorRing()) {
-                                m_output.add_water_polygon(std::move(polygon));
-                            }
+                switch (GEOSGeomTypeId_r(context, geom.get())) {
+                    case GEOS_POLYGON:
+                        if (GEOSisEmpty_r(context, geom.get()) == 0 && !antarctica_bogus(geos_envelope(geom.get()))) {
+                            m_output.add_water_polygon(geom.get());
                         }
                         break;
-                    case wkbMultiPolygon: {
-                            auto mp = static_cast_unique_ptr<OGRMultiPolygon>(std::move(geom));
-                            for (int i = mp->getNumGeometries() - 1; i >= 0; --i) {
-                                auto p = std::unique_ptr<OGRPolygon>(mp->getGeometryRef(i));
-                                assert(p);
-                                mp->removeGeometry(i, FALSE);
-                                p->assignSpatialReference(mp->getSpatialReference());
-                                if (!antarctica_bogus(p.get())) {
-                                    m_output.add_water_polygon(std::move(p));
-                                }
+                    case GEOS_MULTIPOLYGON:
+                        for (int i = GEOSGetNumGeometries_r(context, geom.get()) - 1; i >= 0; --i) {
+                            const GEOSGeometry* p = GEOSGetGeometryN_r(context, geom.get(), i);
+                            assert(p);
+                            if (!antarctica_bogus(geos_envelope(p))) {
+                                m_output.add_water_polygon(p);
                             }
-                            break;
                         }
-                    case wkbGeometryCollection:
+                        break;
+                    case GEOS_GEOMETRYCOLLECTION:
                         // XXX
                         break;
                     default:
@@ -370,7 +393,7 @@ void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_t
                                   << ", "
                                   << envelope.MaxY
                                   << ") type="
-                                  << geom->getGeometryName()
+                                  << geos_type_name(geom.get())
                                   << "\n";
                         // ignore XXX
                         break;
@@ -414,26 +437,25 @@ void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_t
 
         }
 
-        polygon_vector_type v1;
-        polygon_vector_type v2;
-        for (auto& polygon : v) {
+        // The polygons are not copied, they are referenced from both
+        // halves if needed.
+        std::vector<const GEOSGeometry*> v1;
+        std::vector<const GEOSGeometry*> v2;
+        for (const auto* polygon : v) {
 
             /* You might think re-computing the envelope of all those polygons
             again and again might take a lot of time, but I benchmarked it and
             it has no measurable impact. */
-            OGREnvelope polygon_envelope;
-            polygon->getEnvelope(&polygon_envelope);
+            const OGREnvelope polygon_envelope = geos_envelope(polygon);
 
             const bool e1_intersects_e = e1.Intersects(polygon_envelope);
             const bool e2_intersects_e = e2.Intersects(polygon_envelope);
 
-            if (e1_intersects_e && e2_intersects_e) {
-                v1.emplace_back(polygon->clone());
-                v2.push_back(std::move(polygon));
-            } else if (e1_intersects_e) {
-                v1.push_back(std::move(polygon));
-            } else if (e2_intersects_e) {
-                v2.push_back(std::move(polygon));
+            if (e1_intersects_e) {
+                v1.push_back(polygon);
+            }
+            if (e2_intersects_e) {
+                v2.push_back(polygon);
             }
         }
         split_bbox(e1, std::move(v1));
@@ -442,18 +464,25 @@ void CoastlinePolygons::split_bbox(const OGREnvelope& envelope, polygon_vector_t
 }
 
 unsigned int CoastlinePolygons::check_polygons() {
+    convert_to_geos();
+
+    GEOSContextHandle_t context = geos_context();
     unsigned int warnings = 0;
-    polygon_vector_type v;
+    geos_polygon_vector_type v;
 
-    for (auto& polygon : m_polygons) {
-        if (polygon->IsValid()) {
+    for (auto& polygon : m_geos_polygons) {
+        if (polygon.known_valid()) {
+            ++m_skipped_checks;
+            v.push_back(std::move(polygon));
+        } else if (GEOSisValid_r(context, polygon.geometry.get()) == 1) {
+            polygon.valid = validity::final;
             v.push_back(std::move(polygon));
         } else {
             std::cerr << "Invalid polygon, trying buffer(0).\n";
             ++warnings;
-            OGRGeometry* buffered_polygon = polygon->Buffer(0);
-            if (buffered_polygon && buffered_polygon->getGeometryType() == wkbPolygon) {
-                v.emplace_back(static_cast<OGRPolygon*>(buffered_polygon));
+            geos_geometry_ptr buffered_polygon{GEOSBuffer_r(context, polygon.geometry.get(), 0, 30)};
+            if (buffered_polygon && GEOSGeomTypeId_r(context, buffered_polygon.get()) == GEOS_POLYGON) {
+                v.push_back(geos_polygon{std::move(buffered_polygon), validity::unknown});
             } else {
                 std::cerr << "Buffer(0) failed, ignoring this polygon. Output data might be invalid!\n";
             }
@@ -461,7 +490,7 @@ unsigned int CoastlinePolygons::check_polygons() {
     }
 
     using std::swap;
-    swap(m_polygons, v);
+    swap(m_geos_polygons, v);
 
     return warnings;
 }
@@ -489,6 +518,15 @@ void CoastlinePolygons::output_water_polygons() {
         m_env_east.MaxY =  14230080.0;
     }
 
-    split_bbox(srs.max_extent(), std::move(m_polygons));
+    convert_to_geos();
+
+    std::vector<const GEOSGeometry*> polygons;
+    polygons.reserve(m_geos_polygons.size());
+    for (const auto& polygon : m_geos_polygons) {
+        polygons.push_back(polygon.geometry.get());
+    }
+
+    split_bbox(srs.max_extent(), std::move(polygons));
+    m_geos_polygons.clear();
 }
 
@@ -22,8 +22,12 @@
 
 */
 
+#include "geos_geometry.hpp"
+
 #include <ogr_geometry.h>
 
+#include <cassert>
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -31,12 +35,80 @@
 class OGRSpatialReference;
 class OutputDatabase;
 
-using polygon_vector_type = std::vector<std::unique_ptr<OGRPolygon>>;
+/**
+ * Records which step last found a polygon to be valid. Everything that
+ * changes a polygon in a way that could make it invalid resets this to
+ * "unknown", later validity checks are only needed for those polygons.
+ */
+enum class validity : uint8_t {
+    unknown  = 0, ///< not checked since the last change
+    ring     = 1, ///< checked as single ring before assembling polygons
+    assembly = 2, ///< checked with its holes after assembling polygons
+    final    = 3  ///< checked in CoastlinePolygons::check_polygons()
+};
+
+/**
+ * A polygon together with its validity state.
+ */
+struct checked_polygon {
+
+    std::unique_ptr<OGRPolygon> polygon;
+    validity valid = validity::unknown;
+
+    checked_polygon() = default;
+
+    checked_polygon(std::unique_ptr<OGRPolygon>&& p, validity v) noexcept :
+        polygon(std::move(p)),
+        valid(v) {
+    }
+
+    OGRPolygon* get() const noexcept {
+        return polygon.get();
+    }
+
+    OGRPolygon* operator->() const noexcept {
+        return polygon.get();
+    }
+
+    explicit operator bool() const noexcept {
+        return static_cast<bool>(polygon);
+    }
+
+    bool known_valid() const noexcept {
+        return valid != validity::unknown;
+    }
+
+}; // struct checked_polygon
+
+using polygon_vector_type = std::vector<checked_polygon>;
+
+/**
+ * A polygon as GEOS geometry together with its validity state.
+ */
+struct geos_polygon {
+
+    geos_geometry_ptr geometry;
+    validity valid = validity::unknown;
+
+    bool known_valid() const noexcept {
+        return valid != validity::unknown;
+    }
+
+}; // struct geos_polygon
+
+using geos_polygon_vector_type = std::vector<geos_polygon>;
 
 /**
  * A collection of land polygons created out of coastlines.
  * Contains operations for SRS transformation, splitting up of large polygons
  * and converting to water polygons.
+ *
+ * The steps up to the output of the coastlines as lines work on the OGR
+ * polygons. Splitting, checking, and the output of land and water polygons
+ * work on GEOS geometries. The first of those steps converts all polygons
+ * once, so they don't have to be converted between OGR and GEOS for every
+ * GEOS operation. They are only converted back to OGR when they are
+ * written to the output database.
  */
 class CoastlinePolygons {
 
@@ -64,6 +136,15 @@ class CoastlinePolygons {
      */
     polygon_vector_type m_polygons;
 
+    /**
+     * The polygons as GEOS geometries after convert_to_geos() moved them
+     * here from m_polygons. From then on the methods work on this vector.
+     */
+    geos_polygon_vector_type m_geos_polygons;
+
+    /// Were the polygons converted to GEOS geometries?
+    bool m_in_geos = false;
+
     OGREnvelope m_env_west;
     OGREnvelope m_env_east;
 
@@ -72,11 +153,17 @@ class CoastlinePolygons {
      */
     int m_max_split_depth = 0;
 
-    void split_geometry(std::unique_ptr<OGRGeometry>&& geom, int level);
-    void split_polygon(std::unique_ptr<OGRPolygon>&& polygon, int level);
-    void split_bbox(const OGREnvelope& envelope, polygon_vector_type&& v);
+    /// Number of validity checks skipped because the polygon was known valid.
+    unsigned int m_skipped_checks = 0;
+
+    /// Convert the polygons into GEOS geometries (if not done already).
+    void convert_to_geos();
 
-    std::pair<std::unique_ptr<OGRPolygon>, std::unique_ptr<OGRPolygon>> split_envelope(const OGREnvelope& envelope, int level, int num_points) const;
+    void split_geometry(geos_geometry_ptr&& geom, int level);
+    void split_polygon(geos_polygon&& polygon, int level);
+    void split_bbox(const OGREnvelope& envelope, std::vector<const GEOSGeometry*>&& v);
+
+    std::pair<geos_geometry_ptr, geos_geometry_ptr> split_envelope(const OGREnvelope& envelope, int level, int num_points) const;
 
 #if (GDAL_VERSION_NUM >= GDAL_COMPUTE_VERSION(3,7,0))
     void add_line_to_output(std::unique_ptr<OGRLineString> line, const OGRSpatialReference* srs) const;
@@ -96,31 +183,50 @@ public:
 
     /// Number of polygons
     int num_polygons() const noexcept {
-        return m_polygons.size();
+        return m_in_geos ? m_geos_polygons.size() : m_polygons.size();
     }
 
+    // Iterating over the OGR polygons only works before they are
+    // converted to GEOS geometries.
+
     polygon_vector_type::const_iterator begin() const noexcept {
+        assert(!m_in_geos);
         return m_polygons.begin();
     }
 
     polygon_vector_type::const_iterator end() const noexcept {
+        assert(!m_in_geos);
         return m_polygons.end();
     }
 
     /// Turn polygons with wrong winding order around.
     unsigned int fix_direction();
 
-    /// Transform all polygons to output SRS.
+    /**
+     * Transform all polygons to output SRS. The transformed polygons are
+     * not known to be valid any more.
+     */
     void transform();
 
     /// Split up all polygons.
     void split();
 
-    /// Check polygons for validity and try to make them valid if needed
+    /**
+     * Check polygons for validity and try to make them valid if needed.
+     * Polygons already known to be valid are not checked again.
+     */
     unsigned int check_polygons();
 
-    /// Write all land polygons to the output database.
-    void output_land_polygons(bool make_copy);
+    /// Number of validity checks skipped in check_polygons().
+    unsigned int num_skipped_checks() const noexcept {
+        return m_skipped_checks;
+    }
+
+    /**
+     * Write all land polygons to the output database. If keep is false,
+     * the polygons are freed afterwards.
+     */
+    void output_land_polygons(bool keep);
 
     /// Write all water polygons to the output database.
     void output_water_polygons();
@@ -128,7 +234,7 @@ public:
     /// Write all coastlines to the output database (as lines).
     void output_lines(int max_points) const;
 
-    bool antarctica_bogus(const OGRGeometry* geom) noexcept;
+    bool antarctica_bogus(const OGREnvelope& envelope) const noexcept;
 
 }; // class CoastlinePolygons
 
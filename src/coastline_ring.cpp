@@ -20,26 +20,228 @@
 */
 
 #include "coastline_ring.hpp"
+#include "snapshot.hpp"
 
 #include <osmium/geom/ogr.hpp>
 #include <osmium/osm/undirected_segment.hpp>
 
 #include <ogr_geometry.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
 #include <utility>
 #include <vector>
 
-void CoastlineRing::setup_locations(locmap_type& locmap) {
+namespace {
+
+// Flags in the snapshot file
+constexpr const uint32_t snapshot_flag_fixed = 1U;
+
+/**
+ * Iterator over the locations of a compacted ring in the coordinate arena
+ * that can be used with the fill functions of the geometry factory. These
+ * only need it->location(), so the iterator can return itself from
+ * operator->().
+ */
+class arena_location_iterator {
+
+    const CoordinateArena* m_arena;
+    std::size_t m_pos;
+    bool m_reverse;
+
+public:
+
+    arena_location_iterator(const CoordinateArena* arena, std::size_t pos, bool reverse) noexcept :
+        m_arena(arena),
+        m_pos(pos),
+        m_reverse(reverse) {
+    }
+
+    // When going backwards m_pos is one past the current position.
+    osmium::Location location() const noexcept {
+        return m_arena->location(m_reverse ? m_pos - 1 : m_pos);
+    }
+
+    const arena_location_iterator* operator->() const noexcept {
+        return this;
+    }
+
+    arena_location_iterator& operator++() noexcept {
+        if (m_reverse) {
+            --m_pos;
+        } else {
+            ++m_pos;
+        }
+        return *this;
+    }
+
+    bool operator==(const arena_location_iterator& other) const noexcept {
+        return m_pos == other.m_pos;
+    }
+
+    bool operator!=(const arena_location_iterator& other) const noexcept {
+        return !(*this == other);
+    }
+
+}; // class arena_location_iterator
+
+} // anonymous namespace
+
+CoastlineRing::CoastlineRing(SnapshotReader& reader) :
+    m_ring_id(reader.read<int64_t>()),
+    m_nways(reader.read<uint32_t>()) {
+    m_fixed = (reader.read<uint32_t>() & snapshot_flag_fixed) != 0;
+    const auto npoints = reader.read<uint64_t>();
+    if (npoints == 0 || npoints > (reader.remaining() / sizeof(osmium::NodeRef))) {
+        throw std::runtime_error{"Snapshot file '" + reader.filename() + "' is corrupted"};
+    }
+    m_way_node_list.resize(npoints);
+    std::memcpy(m_way_node_list.data(), reader.read(npoints * sizeof(osmium::NodeRef)), npoints * sizeof(osmium::NodeRef));
+
+    const auto nway_starts = reader.read<uint64_t>();
+    if (nway_starts == 0 || nway_starts > npoints) {
+        throw std::runtime_error{"Snapshot file '" + reader.filename() + "' is corrupted"};
+    }
+    m_way_starts.reserve(nway_starts);
+    for (uint64_t n = 0; n < nway_starts; ++n) {
+        const auto id = reader.read<int64_t>();
+        const auto pos = reader.read<uint64_t>();
+        if (pos >= npoints) {
+            throw std::runtime_error{"Snapshot file '" + reader.filename() + "' is corrupted"};
+        }
+        m_way_starts.push_back(way_start{id, pos});
+    }
+}
+
+void CoastlineRing::write_snapshot(SnapshotWriter& writer) const {
+    assert(is_materialized() && !is_compacted());
+    writer.write<int64_t>(m_ring_id);
+    writer.write<uint32_t>(m_nways);
+    writer.write<uint32_t>(m_fixed ? snapshot_flag_fixed : 0U);
+    writer.write<uint64_t>(m_way_node_list.size());
+    writer.write(m_way_node_list.data(), m_way_node_list.size() * sizeof(osmium::NodeRef));
+    writer.write<uint64_t>(m_way_starts.size());
+    for (const auto& ws : m_way_starts) {
+        writer.write<int64_t>(ws.id);
+        writer.write<uint64_t>(ws.pos);
+    }
+}
+
+CoastlineRing::CoastlineRing(const CoastlineRing& ring, std::size_t first_way, std::size_t last_way) :
+    m_ring_id(ring.m_way_starts[first_way].id),
+    m_nways(static_cast<unsigned int>(last_way - first_way + 1)) {
+    assert(ring.is_materialized());
+    assert(first_way <= last_way && last_way < ring.m_way_starts.size());
+
+    const std::size_t begin = ring.m_way_starts[first_way].pos;
+    const std::size_t end = last_way + 1 < ring.m_way_starts.size() ? ring.m_way_starts[last_way + 1].pos + 1 : ring.m_way_node_list.size();
+    m_way_node_list.assign(ring.m_way_node_list.begin() + begin, ring.m_way_node_list.begin() + end);
+
+    for (std::size_t n = first_way; n <= last_way; ++n) {
+        m_way_starts.push_back(way_start{ring.m_way_starts[n].id, ring.m_way_starts[n].pos - begin});
+        update_ring_id(ring.m_way_starts[n].id);
+    }
+}
+
+bool CoastlineRing::contains_any_way(const std::unordered_set<osmium::object_id_type>& way_ids) const {
+    assert(is_materialized() && !is_compacted());
+    return std::any_of(m_way_starts.cbegin(), m_way_starts.cend(), [&way_ids](const way_start& ws) {
+        return way_ids.count(ws.id) > 0;
+    });
+}
+
+std::vector<CoastlineRing> CoastlineRing::split(const std::unordered_set<osmium::object_id_type>& way_ids) const {
+    assert(is_materialized() && !is_compacted());
+    std::vector<CoastlineRing> pieces;
+
+    std::size_t first = 0;
+    for (std::size_t n = 0; n <= m_way_starts.size(); ++n) {
+        if (n == m_way_starts.size() || way_ids.count(m_way_starts[n].id) > 0) {
+            if (first < n) {
+                pieces.emplace_back(*this, first, n - 1);
+            }
+            first = n + 1;
+        }
+    }
+
+    return pieces;
+}
+
+void CoastlineRing::make_slices() {
+    // This is only called before nodes are added to the ring.
+    m_known_valid = false;
+    if (m_slices.empty()) {
+        m_slices.push_back(slice{std::move(m_way_node_list), std::move(m_way_starts), false});
+        m_way_node_list.clear();
+        m_way_starts.clear();
+    }
+}
+
+void CoastlineRing::materialize() {
+    if (m_slices.empty()) {
+        return;
+    }
+
+    m_way_node_list.reserve(npoints());
+    for (auto& s : m_slices) {
+        const std::size_t base = s.shares_first_node ? m_way_node_list.size() - 1 : m_way_node_list.size();
+        for (const auto& ws : s.way_starts) {
+            m_way_starts.push_back(way_start{ws.id, base + ws.pos});
+        }
+        m_way_node_list.insert(m_way_node_list.end(), s.nodes.begin() + (s.shares_first_node ? 1 : 0), s.nodes.end());
+    }
+    m_slices.clear();
+}
+
+void CoastlineRing::compact(CoordinateArena& arena) {
+    assert(is_materialized() && !is_compacted());
+    assert(!m_way_node_list.empty());
+
+    m_first_node_id = m_way_node_list.front().ref();
+    m_last_node_id = m_way_node_list.back().ref();
+    m_arena_offset = arena.size();
+    m_arena_size = m_way_node_list.size();
+    for (const auto& wn : m_way_node_list) {
+        assert(wn.location());
+        arena.push_back(wn.location());
+    }
+    m_arena = &arena;
+
+    // Really free the memory, clear() would not do that.
+    std::vector<osmium::NodeRef>{}.swap(m_way_node_list);
+    std::vector<way_start>{}.swap(m_way_starts);
+}
+
+void CoastlineRing::append_location(osmium::Location location) {
+    assert(is_compacted());
+    m_known_valid = false;
+    if (m_arena_offset + m_arena_size != m_arena->size()) {
+        m_arena_offset = m_arena->copy_to_end(m_arena_offset, m_arena_size);
+    }
+    m_arena->push_back(location);
+    ++m_arena_size;
+}
+
+void CoastlineRing::setup_locations(LocationMap& locmap) {
+    assert(is_materialized() && !is_compacted());
+    m_known_valid = false;
     for (auto& wn : m_way_node_list) {
-        locmap.insert(std::make_pair(wn.ref(), &(wn.location())));
+        // The location might already be there if the input file has node
+        // locations on ways.
+        if (!wn.location()) {
+            locmap.add(wn.ref(), &(wn.location()));
+        }
     }
 }
 
 unsigned int CoastlineRing::check_locations(bool output_missing) {
+    assert(is_materialized() && !is_compacted());
     unsigned int missing_locations = 0;
 
     for (const auto& wn : m_way_node_list) {
@@ -56,7 +258,9 @@ unsigned int CoastlineRing::check_locations(bool output_missing) {
 
 void CoastlineRing::add_at_front(const osmium::Way& way) {
     assert(first_node_id() == way.nodes().back().ref());
-    m_way_node_list.insert(m_way_node_list.begin(), way.nodes().begin(), way.nodes().end()-1);
+    make_slices();
+    m_slices.front().shares_first_node = true;
+    m_slices.push_front(slice{std::vector<osmium::NodeRef>(way.nodes().begin(), way.nodes().end()), {way_start{way.id(), 0}}, false});
 
     update_ring_id(way.id());
     m_nways++;
@@ -64,26 +268,48 @@ void CoastlineRing::add_at_front(const osmium::Way& way) {
 
 void CoastlineRing::add_at_end(const osmium::Way& way) {
     assert(last_node_id() == way.nodes().front().ref());
-    m_way_node_list.insert(m_way_node_list.end(), way.nodes().begin()+1, way.nodes().end());
+    make_slices();
+    m_slices.push_back(slice{std::vector<osmium::NodeRef>(way.nodes().begin(), way.nodes().end()), {way_start{way.id(), 0}}, true});
 
     update_ring_id(way.id());
     m_nways++;
 }
 
-void CoastlineRing::join(const CoastlineRing& other) {
+void CoastlineRing::add_at_front(CoastlineRing& other) {
+    assert(first_node_id() == other.last_node_id());
+    make_slices();
+    other.make_slices();
+    m_slices.front().shares_first_node = true;
+    m_slices.splice(m_slices.begin(), other.m_slices);
+
+    update_ring_id(other.ring_id());
+    m_nways += other.m_nways;
+}
+
+void CoastlineRing::join(CoastlineRing& other) {
     assert(last_node_id() == other.first_node_id());
-    m_way_node_list.insert(m_way_node_list.end(), other.m_way_node_list.begin()+1, other.m_way_node_list.end());
+    make_slices();
+    other.make_slices();
+    other.m_slices.front().shares_first_node = true;
+    m_slices.splice(m_slices.end(), other.m_slices);
 
     update_ring_id(other.ring_id());
     m_nways += other.m_nways;
 }
 
 void CoastlineRing::join_over_gap(const CoastlineRing& other) {
+    assert(is_compacted() && other.is_compacted());
     if (last_location() != other.first_location()) {
-        m_way_node_list.push_back(other.m_way_node_list.front());
+        append_location(other.first_location());
+        m_last_node_id = other.m_first_node_id;
     }
 
-    m_way_node_list.insert(m_way_node_list.end(), other.m_way_node_list.begin()+1, other.m_way_node_list.end());
+    for (std::size_t n = 1; n < other.m_arena_size; ++n) {
+        append_location(other.m_arena->location(other.m_arena_offset + n));
+    }
+    if (other.m_arena_size > 1) {
+        m_last_node_id = other.m_last_node_id;
+    }
 
     update_ring_id(other.ring_id());
     m_nways += other.m_nways;
@@ -91,84 +317,88 @@ void CoastlineRing::join_over_gap(const CoastlineRing& other) {
 }
 
 void CoastlineRing::close_ring() {
+    assert(is_compacted());
     if (first_location() != last_location()) {
-        m_way_node_list.push_back(m_way_node_list.front());
+        append_location(first_location());
+        m_last_node_id = m_first_node_id;
     }
     m_fixed = true;
 }
 
 void CoastlineRing::close_antarctica_ring(int epsg) {
+    assert(is_compacted());
     const double min = epsg == 4326 ? -90.0 : -85.0511288;
 
     for (int lat = -78; lat > static_cast<int>(min); --lat) {
-        m_way_node_list.emplace_back(0, osmium::Location{-180.0, static_cast<double>(lat)});
+        append_location(osmium::Location{-180.0, static_cast<double>(lat)});
     }
 
     for (int lon = -180; lon < 180; ++lon) {
-        m_way_node_list.emplace_back(0, osmium::Location{static_cast<double>(lon), min});
+        append_location(osmium::Location{static_cast<double>(lon), min});
     }
 
     if (epsg == 3857) {
-        m_way_node_list.emplace_back(0, osmium::Location{180.0, min});
+        append_location(osmium::Location{180.0, min});
     }
 
     for (auto lat = static_cast<int>(min); lat < -78; ++lat) {
-        m_way_node_list.emplace_back(0, osmium::Location{180.0, static_cast<double>(lat)});
+        append_location(osmium::Location{180.0, static_cast<double>(lat)});
     }
 
-    m_way_node_list.push_back(m_way_node_list.front());
+    append_location(first_location());
+    m_last_node_id = m_first_node_id;
     m_fixed = true;
 }
 
 std::unique_ptr<OGRPolygon> CoastlineRing::ogr_polygon(osmium::geom::OGRFactory<>& geom_factory, bool reverse) const {
+    assert(is_compacted());
+    const arena_location_iterator begin{m_arena, reverse ? m_arena_offset + m_arena_size : m_arena_offset, reverse};
+    const arena_location_iterator end{m_arena, reverse ? m_arena_offset : m_arena_offset + m_arena_size, reverse};
     geom_factory.polygon_start();
-    std::size_t num_points = 0;
-    if (reverse) {
-        num_points = geom_factory.fill_polygon(m_way_node_list.crbegin(), m_way_node_list.crend());
-    } else {
-        num_points = geom_factory.fill_polygon(m_way_node_list.cbegin(), m_way_node_list.cend());
-    }
+    const std::size_t num_points = geom_factory.fill_polygon(begin, end);
     return geom_factory.polygon_finish(num_points);
 }
 
 std::unique_ptr<OGRLineString> CoastlineRing::ogr_linestring(osmium::geom::OGRFactory<>& geom_factory, bool reverse) const {
+    assert(is_compacted());
+    const arena_location_iterator begin{m_arena, reverse ? m_arena_offset + m_arena_size : m_arena_offset, reverse};
+    const arena_location_iterator end{m_arena, reverse ? m_arena_offset : m_arena_offset + m_arena_size, reverse};
     geom_factory.linestring_start();
-    std::size_t num_points = 0;
-    if (reverse) {
-        num_points = geom_factory.fill_linestring(m_way_node_list.crbegin(), m_way_node_list.crend());
-    } else {
-        num_points = geom_factory.fill_linestring(m_way_node_list.cbegin(), m_way_node_list.cend());
-    }
+    const std::size_t num_points = geom_factory.fill_linestring(begin, end);
     return geom_factory.linestring_finish(num_points);
 }
 
 std::unique_ptr<OGRPoint> CoastlineRing::ogr_first_point() const {
-    assert(!m_way_node_list.empty());
-    const osmium::NodeRef& node_ref = m_way_node_list.front();
-    return std::make_unique<OGRPoint>(node_ref.lon(), node_ref.lat());
+    const osmium::Location location = first_location();
+    return std::make_unique<OGRPoint>(location.lon(), location.lat());
 }
 
 std::unique_ptr<OGRPoint> CoastlineRing::ogr_last_point() const {
-    assert(!m_way_node_list.empty());
-    const osmium::NodeRef& node_ref = m_way_node_list.back();
-    return std::make_unique<OGRPoint>(node_ref.lon(), node_ref.lat());
+    const osmium::Location location = last_location();
+    return std::make_unique<OGRPoint>(location.lon(), location.lat());
 }
 
 // Pythagoras doesn't work on a round earth but that is ok here, we only need a
 // rough measure anyway
 double CoastlineRing::distance_to_start_location(osmium::Location pos) const {
-    assert(!m_way_node_list.empty());
-    const osmium::Location p = m_way_node_list.front().location();
+    const osmium::Location p = first_location();
     return ((pos.lon() - p.lon()) * (pos.lon() - p.lon())) +
            ((pos.lat() - p.lat()) * (pos.lat() - p.lat()));
 }
 
-void CoastlineRing::add_segments_to_vector(std::vector<osmium::UndirectedSegment>& segments) const {
-    if (m_way_node_list.size() > 1) {
-        for (auto it = m_way_node_list.begin(); it != m_way_node_list.end() - 1; ++it) {
-            segments.emplace_back(it->location(), (it+1)->location());
+bool CoastlineRing::contains_any_segment(const std::vector<osmium::UndirectedSegment>& segments) const {
+    assert(is_compacted());
+    if (segments.empty()) {
+        return false;
+    }
+    const std::size_t end = m_arena_offset + m_arena_size;
+    for (std::size_t n = m_arena_offset + 1; n < end; ++n) {
+        const osmium::UndirectedSegment segment{m_arena->location(n - 1), m_arena->location(n)};
+        if (std::binary_search(segments.begin(), segments.end(), segment)) {
+            return true;
         }
     }
+    return false;
 }
 
 std::ostream& operator<<(std::ostream& out, const CoastlineRing& cp) {
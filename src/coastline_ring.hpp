@@ -22,21 +22,26 @@
 
 */
 
+#include "coordinate_arena.hpp"
+#include "location_map.hpp"
+
 #include <osmium/geom/ogr.hpp>
 #include <osmium/osm/undirected_segment.hpp>
 #include <osmium/osm/way.hpp>
 
 #include <cassert>
-#include <map>
+#include <cstddef>
+#include <list>
 #include <memory>
 #include <ostream>
+#include <unordered_set>
 #include <vector>
 
 class OGRPoint;
 class OGRLineString;
 class OGRPolygon;
-
-using locmap_type = std::multimap<osmium::object_id_type, osmium::Location*>;
+class SnapshotReader;
+class SnapshotWriter;
 
 /**
  * The CoastlineRing class models a (possibly unfinished) ring of
@@ -52,6 +57,22 @@ using locmap_type = std::multimap<osmium::object_id_type, osmium::Location*>;
  * To get a unique ID for the coastline ring, the minimum way
  * ID is also kept.
  *
+ * For each way making up the ring the position of its first node in
+ * the ring is kept, so that the ring can later be split into its ways
+ * again when some of them change.
+ *
+ * While the ring is assembled from ways, the nodes are kept in a list of
+ * slices, one for each way or ring added. Only when the ring is closed or
+ * when the assembly is done, the ring is "materialized", ie. the slices
+ * are copied into one contiguous list of nodes. This way adding ways at
+ * the front and joining rings doesn't copy all nodes again and again. Most
+ * functions need a materialized ring.
+ *
+ * Once all node locations are known, the ring can be "compacted": The
+ * locations are moved into a CoordinateArena shared by all rings and only
+ * the IDs of the first and last node are kept. From then on only the
+ * functions working on the geometry can be used.
+ *
  * By definition coastlines in OSM are tagged as natural=coastline
  * and the land is always to the *left* of the way, the water to
  * the right. So a ring around an island is going counter-clockwise.
@@ -64,8 +85,37 @@ using locmap_type = std::multimap<osmium::object_id_type, osmium::Location*>;
  */
 class CoastlineRing {
 
+public:
+
+    struct way_start {
+        osmium::object_id_type id;
+        std::size_t pos;
+    };
+
+private:
+
+    struct slice {
+        std::vector<osmium::NodeRef> nodes;
+
+        /// Positions are relative to the beginning of this slice.
+        std::vector<way_start> way_starts;
+
+        /// Is the first node the same as the last node of the previous slice?
+        bool shares_first_node;
+    };
+
     std::vector<osmium::NodeRef> m_way_node_list{};
 
+    /// Slices of the ring if it is not materialized.
+    std::list<slice> m_slices{};
+
+    /**
+     * IDs of the ways making up this ring and the positions of their first
+     * nodes in m_way_node_list in the order of the ways in the ring. Each
+     * way ends at the start of the next way or at the end of the ring.
+     */
+    std::vector<way_start> m_way_starts{};
+
     /**
      * Smallest ID of all the ways making up the ring. Can be used as somewhat
      * stable unique ID for the ring.
@@ -84,18 +134,70 @@ class CoastlineRing {
     /// Is this an outer ring?
     bool m_outer = false;
 
+    /**
+     * The polygon made from this ring is known to be valid, because the
+     * intersection check found no problems with its segments or because
+     * it was checked when writing it out. This is reset by everything
+     * that changes the nodes or locations of the ring.
+     */
+    bool m_known_valid = false;
+
+    /// Arena with the coordinates if the ring was compacted.
+    CoordinateArena* m_arena = nullptr;
+
+    /// Position of the first coordinate of this ring in the arena.
+    std::size_t m_arena_offset = 0;
+
+    /// Number of coordinates of this ring in the arena.
+    std::size_t m_arena_size = 0;
+
+    /// IDs of first and last node if the ring was compacted.
+    osmium::object_id_type m_first_node_id = 0;
+    osmium::object_id_type m_last_node_id = 0;
+
+    /// Move contents of a materialized ring into the first slice.
+    void make_slices();
+
+    const osmium::NodeRef& front_node() const noexcept {
+        return m_slices.empty() ? m_way_node_list.front() : m_slices.front().nodes.front();
+    }
+
+    const osmium::NodeRef& back_node() const noexcept {
+        return m_slices.empty() ? m_way_node_list.back() : m_slices.back().nodes.back();
+    }
+
+    /// Add a location to the end of a compacted ring.
+    void append_location(osmium::Location location);
+
 public:
 
     /**
-     * Create CoastlineRing from a way.
+     * Create CoastlineRing from a way. If the way has node locations
+     * they are copied, too.
      */
     explicit CoastlineRing(const osmium::Way& way) :
+        m_way_node_list(way.nodes().begin(), way.nodes().end()),
+        m_way_starts({way_start{way.id(), 0}}),
         m_ring_id(way.id()) {
         assert(!way.nodes().empty());
-        m_way_node_list.reserve(way.is_closed() ? way.nodes().size() : 1000);
-        m_way_node_list.insert(m_way_node_list.begin(), way.nodes().begin(), way.nodes().end());
     }
 
+    /**
+     * Create CoastlineRing from the ways first_way to last_way (inclusive,
+     * indexes into the list of ways) of another ring.
+     */
+    CoastlineRing(const CoastlineRing& ring, std::size_t first_way, std::size_t last_way);
+
+    /**
+     * Create CoastlineRing from the next ring in a snapshot file.
+     */
+    explicit CoastlineRing(SnapshotReader& reader);
+
+    /**
+     * Write this ring to a snapshot file.
+     */
+    void write_snapshot(SnapshotWriter& writer) const;
+
     bool is_outer() const noexcept {
         return m_outer;
     }
@@ -104,28 +206,53 @@ public:
         m_outer = true;
     }
 
+    /// Is the polygon made from this ring known to be valid?
+    bool is_known_valid() const noexcept {
+        return m_known_valid;
+    }
+
+    void set_known_valid(bool valid) noexcept {
+        m_known_valid = valid;
+    }
+
+    /// Has the ring been materialized?
+    bool is_materialized() const noexcept {
+        return m_slices.empty();
+    }
+
+    /// Copy all slices into one list of nodes.
+    void materialize();
+
+    /// Has the ring been compacted?
+    bool is_compacted() const noexcept {
+        return m_arena != nullptr;
+    }
+
+    /**
+     * Move the node locations into the arena and forget about all node
+     * IDs except those of the first and last node and about the ways.
+     * The ring must be materialized and all locations must be set.
+     */
+    void compact(CoordinateArena& arena);
+
     /// ID of first node in the ring.
     osmium::object_id_type first_node_id() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.front().ref();
+        return is_compacted() ? m_first_node_id : front_node().ref();
     }
 
     /// ID of last node in the ring.
     osmium::object_id_type last_node_id() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.back().ref();
+        return is_compacted() ? m_last_node_id : back_node().ref();
     }
 
     /// Location of the first node in the ring.
     osmium::Location first_location() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.front().location();
+        return is_compacted() ? m_arena->location(m_arena_offset) : front_node().location();
     }
 
     /// Location of the last node in the ring.
     osmium::Location last_location() const noexcept {
-        assert(!m_way_node_list.empty());
-        return m_way_node_list.back().location();
+        return is_compacted() ? m_arena->location(m_arena_offset + m_arena_size - 1) : back_node().location();
     }
 
     /// Return ID of this ring (defined as smallest ID of the ways making up the ring).
@@ -148,9 +275,67 @@ public:
         return m_nways;
     }
 
+    /// The IDs and start positions of the ways making up this ring.
+    const std::vector<way_start>& way_starts() const noexcept {
+        assert(is_materialized() && !is_compacted());
+        return m_way_starts;
+    }
+
+    /// Does this ring contain any of the specified ways?
+    bool contains_any_way(const std::unordered_set<osmium::object_id_type>& way_ids) const;
+
+    /**
+     * Split this ring into pieces by removing the specified ways. Each
+     * piece is made up of consecutive ways not in way_ids. Returns the
+     * pieces in the order of the ring.
+     */
+    std::vector<CoastlineRing> split(const std::unordered_set<osmium::object_id_type>& way_ids) const;
+
+    /**
+     * Call the function with the node ID and a reference to the location
+     * for each node in this ring.
+     */
+    template <typename TFunc>
+    void for_each_location(TFunc&& func) {
+        assert(is_materialized() && !is_compacted());
+        m_known_valid = false;
+        for (auto& wn : m_way_node_list) {
+            func(wn.ref(), wn.location());
+        }
+    }
+
+    /**
+     * Call the function with the node ID and the location for each node
+     * of the specified ways in this ring. Nodes shared by two of the ways
+     * are reported twice.
+     */
+    template <typename TFunc>
+    void for_each_location_of_ways(const std::unordered_set<osmium::object_id_type>& way_ids, TFunc&& func) const {
+        assert(is_materialized() && !is_compacted());
+        for (std::size_t n = 0; n < m_way_starts.size(); ++n) {
+            if (way_ids.count(m_way_starts[n].id) == 0) {
+                continue;
+            }
+            const std::size_t last = n + 1 < m_way_starts.size() ? m_way_starts[n + 1].pos : m_way_node_list.size() - 1;
+            for (std::size_t pos = m_way_starts[n].pos; pos <= last; ++pos) {
+                func(m_way_node_list[pos].ref(), m_way_node_list[pos].location());
+            }
+        }
+    }
+
     /// Returns the number of points in this ring.
     unsigned int npoints() const noexcept {
-        return m_way_node_list.size();
+        if (is_compacted()) {
+            return m_arena_size;
+        }
+        if (m_slices.empty()) {
+            return m_way_node_list.size();
+        }
+        std::size_t size = 0;
+        for (const auto& s : m_slices) {
+            size += s.nodes.size() - (s.shares_first_node ? 1 : 0);
+        }
+        return size;
     }
 
     /// Returns true if the ring is closed.
@@ -172,16 +357,17 @@ public:
      * method does this.
      */
     void fake_close() noexcept {
-        assert(!m_way_node_list.empty());
-        m_way_node_list.back().set_ref(first_node_id());
+        assert(is_compacted());
+        m_last_node_id = m_first_node_id;
     }
 
     /**
      * Add pointers to the node locations to the given locmap. The
      * locmap can than later be used to directly put the locations
-     * into the right place.
+     * into the right place. Nodes that already have a location (from
+     * node locations on ways in the input file) are not added.
      */
-    void setup_locations(locmap_type& locmap);
+    void setup_locations(LocationMap& locmap);
 
     /**
      * Check whether all node locations for the ways are there. This
@@ -196,16 +382,33 @@ public:
     /// Add a new way to the end of this ring.
     void add_at_end(const osmium::Way& way);
 
+    /**
+     * Add another ring to the front of this ring. The last node ID of the
+     * other ring must be the same as the first node ID of this ring.
+     * The nodes are moved from the other ring, it must be destroyed
+     * afterwards.
+     */
+    void add_at_front(CoastlineRing& other);
+
+    /**
+     * Add another ring to the end of this ring. Same as join().
+     */
+    void add_at_end(CoastlineRing& other) {
+        join(other);
+    }
+
     /**
      * Join the other ring to this one. The first node ID of the
      * other ring must be the same as the last node ID of this
      * ring.
-     * The other ring can be destroyed afterwards.
+     * The nodes are moved from the other ring, it must be destroyed
+     * afterwards.
      */
-    void join(const CoastlineRing& other);
+    void join(CoastlineRing& other);
 
     /**
-     * Join the other ring to this one, possibly over a gap.
+     * Join the other ring to this one, possibly over a gap. Both rings
+     * must be compacted.
      * The other ring can be destroyed afterwards.
      */
     void join_over_gap(const CoastlineRing& other);
@@ -257,7 +460,21 @@ public:
 
     double distance_to_start_location(osmium::Location pos) const;
 
-    void add_segments_to_vector(std::vector<osmium::UndirectedSegment>& segments) const;
+    /// Call the function with each segment of this ring.
+    template <typename TFunc>
+    void for_each_segment(TFunc&& func) const {
+        assert(is_compacted());
+        const std::size_t end = m_arena_offset + m_arena_size;
+        for (std::size_t n = m_arena_offset + 1; n < end; ++n) {
+            func(osmium::UndirectedSegment{m_arena->location(n - 1), m_arena->location(n)});
+        }
+    }
+
+    /**
+     * Does this ring contain any of the segments? The segments must be
+     * sorted.
+     */
+    bool contains_any_segment(const std::vector<osmium::UndirectedSegment>& segments) const;
 
     friend std::ostream& operator<<(std::ostream& out, const CoastlineRing& cp);
 
@@ -21,120 +21,395 @@
 
 #include "coastline_polygons.hpp"
 #include "coastline_ring_collection.hpp"
+#include "interval_tree.hpp"
+#include "location_grid.hpp"
 #include "output_database.hpp"
+#include "segment_file.hpp"
+#include "segment_intersection.hpp"
+#include "segment_runs.hpp"
+#include "snapshot.hpp"
 #include "srs.hpp"
+#include "util.hpp"
+
+#include <osmium/thread/pool.hpp>
 
 #include <ogr_geometry.h>
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
-#ifdef _MSC_VER
-#include <io.h>
-#include <BaseTsd.h>
-#endif
-
 extern SRS srs;
 extern bool debug;
 
+namespace {
+
+osmium::object_id_type first_node_id(const osmium::Way& way) noexcept {
+    return way.nodes().front().ref();
+}
+
+osmium::object_id_type last_node_id(const osmium::Way& way) noexcept {
+    return way.nodes().back().ref();
+}
+
+CoastlineRing make_ring(const osmium::Way& way) {
+    return CoastlineRing{way};
+}
+
+osmium::object_id_type first_node_id(const CoastlineRing& ring) noexcept {
+    return ring.first_node_id();
+}
+
+osmium::object_id_type last_node_id(const CoastlineRing& ring) noexcept {
+    return ring.last_node_id();
+}
+
+CoastlineRing make_ring(CoastlineRing& ring) {
+    return std::move(ring);
+}
+
+} // anonymous namespace
+
+IdIndexMap::index_type CoastlineRingCollection::add_ring(CoastlineRing&& ring) {
+    if (m_rings.size() >= IdIndexMap::not_found) {
+        throw std::runtime_error{"Too many coastline rings"};
+    }
+    m_rings.push_back(std::move(ring));
+    m_removed.push_back(false);
+    return static_cast<IdIndexMap::index_type>(m_rings.size() - 1);
+}
+
+void CoastlineRingCollection::remove_ring(IdIndexMap::index_type index) {
+    assert(!m_removed[index]);
+    m_removed[index] = true;
+    ++m_num_removed;
+
+    // Free the memory now, the ring will never be used again.
+    CoastlineRing removed{std::move(m_rings[index])};
+}
+
 /**
- * If a way is not closed adding it to the coastline collection is a bit
- * complicated.
- * We'll check if there is an existing CoastlineRing that our way connects
+ * Remove all rings marked as removed from the vector keeping the order of
+ * the other rings and update the indexes in the start and end node maps.
+ */
+void CoastlineRingCollection::compact() {
+    if (m_num_removed == 0) {
+        return;
+    }
+
+    std::vector<IdIndexMap::index_type> new_index(m_rings.size());
+    IdIndexMap::index_type n = 0;
+    for (std::size_t i = 0; i < m_rings.size(); ++i) {
+        if (m_removed[i]) {
+            new_index[i] = IdIndexMap::not_found;
+        } else {
+            new_index[i] = n;
+            if (n != i) {
+                m_rings[n] = std::move(m_rings[i]);
+            }
+            ++n;
+        }
+    }
+    m_rings.erase(m_rings.begin() + n, m_rings.end());
+    m_removed.assign(n, false);
+    m_num_removed = 0;
+
+    const auto update = [&new_index](IdIndexMap::index_type index) {
+        assert(new_index[index] != IdIndexMap::not_found);
+        return new_index[index];
+    };
+    m_start_nodes.update_values(update);
+    m_end_nodes.update_values(update);
+}
+
+/**
+ * If a way (or a piece of a ring made up of several ways) is not closed
+ * adding it to the coastline collection is a bit complicated.
+ * We'll check if there is an existing CoastlineRing that our piece connects
  * to and add it to that ring. If there is none, we'll create a new
  * CoastlineRing for it and add that to the collection.
  */
-void CoastlineRingCollection::add_partial_ring(const osmium::Way& way) {
-    assert(!way.nodes().empty());
-    const auto mprev = m_end_nodes.find(way.nodes().front().ref());
-    const auto mnext = m_start_nodes.find(way.nodes().back().ref());
+template <typename TPiece>
+void CoastlineRingCollection::add_partial_ring_impl(TPiece& piece) {
+    const auto prev = m_end_nodes.get(first_node_id(piece));
+    const auto next = m_start_nodes.get(last_node_id(piece));
 
-    // There is no CoastlineRing yet where this way could fit. So we
+    // There is no CoastlineRing yet where this piece could fit. So we
     // create one and add it to the collection.
-    if (mprev == m_end_nodes.end() &&
-        mnext == m_start_nodes.end()) {
-        const auto added = m_list.insert(m_list.end(), std::make_shared<CoastlineRing>(way));
-        m_start_nodes[way.nodes().front().ref()] = added;
-        m_end_nodes[way.nodes().back().ref()] = added;
+    if (prev == IdIndexMap::not_found && next == IdIndexMap::not_found) {
+        const auto first_id = first_node_id(piece);
+        const auto last_id = last_node_id(piece);
+        const auto added = add_ring(make_ring(piece));
+        m_start_nodes.set(first_id, added);
+        m_end_nodes.set(last_id, added);
         return;
     }
 
-    // We found a CoastlineRing where we can add the way at the end.
-    if (mprev != m_end_nodes.end()) {
-        const auto prev = mprev->second;
-        (*prev)->add_at_end(way);
-        m_end_nodes.erase(mprev);
+    // We found a CoastlineRing where we can add the piece at the end.
+    if (prev != IdIndexMap::not_found) {
+        CoastlineRing& prev_ring = m_rings[prev];
+        m_end_nodes.erase(first_node_id(piece));
+        prev_ring.add_at_end(piece);
 
-        if ((*prev)->is_closed()) {
-            const auto found = m_start_nodes.find((*prev)->first_node_id());
-            if (found != m_start_nodes.end()) {
-                m_start_nodes.erase(found);
-            }
+        if (prev_ring.is_closed()) {
+            prev_ring.materialize();
+            m_start_nodes.erase(prev_ring.first_node_id());
             return;
         }
 
         // We also found a CoastlineRing where we could have added the
-        // way at the front. This means that the way together with the
+        // piece at the front. This means that the piece together with the
         // ring at front and the ring at back are now a complete ring.
-        if (mnext != m_start_nodes.end()) {
-            const auto next = mnext->second;
-            (*prev)->join(**next);
-            m_start_nodes.erase(mnext);
-            if ((*prev)->is_closed()) {
-                auto x = m_start_nodes.find((*prev)->first_node_id());
-                if (x != m_start_nodes.end()) {
-                    m_start_nodes.erase(x);
-                }
-                x = m_end_nodes.find((*prev)->last_node_id());
-                if (x != m_end_nodes.end()) {
-                    m_end_nodes.erase(x);
-                }
+        if (next != IdIndexMap::not_found) {
+            CoastlineRing& next_ring = m_rings[next];
+            m_start_nodes.erase(next_ring.first_node_id());
+            prev_ring.join(next_ring);
+            if (prev_ring.is_closed()) {
+                prev_ring.materialize();
+                m_start_nodes.erase(prev_ring.first_node_id());
+                m_end_nodes.erase(prev_ring.last_node_id());
             }
-            m_list.erase(next);
+            remove_ring(next);
         }
 
-        m_end_nodes[(*prev)->last_node_id()] = prev;
+        m_end_nodes.set(prev_ring.last_node_id(), prev);
+        return;
+    }
+
+    // We found a CoastlineRing where we can add the piece at the front.
+    CoastlineRing& next_ring = m_rings[next];
+    m_start_nodes.erase(last_node_id(piece));
+    next_ring.add_at_front(piece);
+    if (next_ring.is_closed()) {
+        next_ring.materialize();
+        m_end_nodes.erase(next_ring.last_node_id());
         return;
     }
+    m_start_nodes.set(next_ring.first_node_id(), next);
+}
 
-    // We found a CoastlineRing where we can add the way at the front.
-    if (mnext != m_start_nodes.end()) {
-        const auto next = mnext->second;
-        (*next)->add_at_front(way);
-        m_start_nodes.erase(mnext);
-        if ((*next)->is_closed()) {
-            const auto found = m_end_nodes.find((*next)->last_node_id());
-            if (found != m_end_nodes.end()) {
-                m_end_nodes.erase(found);
+void CoastlineRingCollection::add_partial_ring(const osmium::Way& way) {
+    assert(!way.nodes().empty());
+    add_partial_ring_impl(way);
+}
+
+void CoastlineRingCollection::finish_assembly() {
+    compact();
+    for (auto& ring : m_rings) {
+        ring.materialize();
+    }
+}
+
+void CoastlineRingCollection::add_piece(CoastlineRing& piece) {
+    if (piece.is_closed()) {
+        add_ring(std::move(piece));
+    } else {
+        add_partial_ring_impl(piece);
+    }
+}
+
+std::size_t CoastlineRingCollection::remove_ways(const std::unordered_set<osmium::object_id_type>& way_ids,
+                                                 std::unordered_map<osmium::object_id_type, osmium::Location>* locations) {
+    std::vector<CoastlineRing> pieces;
+    std::size_t affected_rings = 0;
+
+    for (IdIndexMap::index_type index = 0; index < m_rings.size(); ++index) {
+        const CoastlineRing& ring = m_rings[index];
+        if (m_removed[index] || !ring.contains_any_way(way_ids)) {
+            continue;
+        }
+
+        ++affected_rings;
+        for (const auto& ws : ring.way_starts()) {
+            if (way_ids.count(ws.id) > 0) {
+                --m_ways;
+            }
+        }
+        if (ring.nways() == 1 && ring.is_closed()) {
+            --m_rings_from_single_way;
+        }
+
+        if (!ring.is_closed()) {
+            if (m_start_nodes.get(ring.first_node_id()) == index) {
+                m_start_nodes.erase(ring.first_node_id());
+            }
+            if (m_end_nodes.get(ring.last_node_id()) == index) {
+                m_end_nodes.erase(ring.last_node_id());
             }
-            return;
         }
-        m_start_nodes[(*next)->first_node_id()] = next;
+
+        // The nodes of the removed ways are not in any ring after this.
+        ring.for_each_location_of_ways(way_ids, [locations](osmium::object_id_type id, osmium::Location location) {
+            locations->emplace(id, location);
+        });
+
+        auto ring_pieces = ring.split(way_ids);
+        std::move(ring_pieces.begin(), ring_pieces.end(), std::back_inserter(pieces));
+        remove_ring(index);
+    }
+
+    for (auto& piece : pieces) {
+        add_piece(piece);
+    }
+
+    return affected_rings;
+}
+
+void CoastlineRingCollection::update_locations(const std::unordered_map<osmium::object_id_type, osmium::Location>& locations) {
+    if (locations.empty()) {
+        return;
+    }
+    for (auto& ring : m_rings) {
+        ring.for_each_location([&locations](osmium::object_id_type id, osmium::Location& location) {
+            const auto it = locations.find(id);
+            if (it != locations.end()) {
+                location = it->second;
+            }
+        });
+    }
+}
+
+void CoastlineRingCollection::set_locations_from_rings(LocationMap& locmap) {
+    if (locmap.empty()) {
+        return;
+    }
+    for (auto& ring : m_rings) {
+        ring.for_each_location([&locmap](osmium::object_id_type id, const osmium::Location& location) {
+            if (location && locmap.might_contain(id)) {
+                locmap.set(id, location);
+            }
+        });
     }
 }
 
-void CoastlineRingCollection::setup_locations(locmap_type& locmap) {
-    for (const auto& ring : m_list) {
-        ring->setup_locations(locmap);
+void CoastlineRingCollection::setup_locations(LocationMap& locmap) {
+    std::size_t size = 0;
+    for (auto& ring : m_rings) {
+        size += ring.check_locations(false);
+    }
+    locmap.reserve(size);
+
+    for (auto& ring : m_rings) {
+        ring.setup_locations(locmap);
     }
+
+    locmap.sort();
 }
 
 unsigned int CoastlineRingCollection::check_locations(bool output_missing) {
     unsigned int missing_locations = 0;
 
-    for (const auto& ring : m_list) {
-        missing_locations += ring->check_locations(output_missing);
+    for (auto& ring : m_rings) {
+        missing_locations += ring.check_locations(output_missing);
     }
 
     return missing_locations;
 }
 
+void CoastlineRingCollection::compact_coordinates() {
+    assert(m_num_removed == 0);
+    std::size_t size = 0;
+    for (const auto& ring : m_rings) {
+        size += ring.npoints();
+    }
+    m_arena.reserve(size);
+
+    for (auto& ring : m_rings) {
+        ring.compact(m_arena);
+    }
+}
+
 namespace {
 
+void write_end_nodes(SnapshotWriter& writer, const IdIndexMap& nodes) {
+    writer.write<uint64_t>(nodes.size());
+    for (const auto& node : nodes.sorted_entries()) {
+        writer.write<int64_t>(node.first);
+        writer.write<uint64_t>(node.second);
+    }
+}
+
+void read_end_nodes(SnapshotReader& reader, IdIndexMap& nodes, uint64_t num_rings) {
+    const auto size = reader.read<uint64_t>();
+    for (uint64_t n = 0; n < size; ++n) {
+        const auto id = reader.read<int64_t>();
+        const auto ring = reader.read<uint64_t>();
+        if (ring >= num_rings) {
+            throw std::runtime_error{"Snapshot file '" + reader.filename() + "' is corrupted"};
+        }
+        nodes.set(id, static_cast<IdIndexMap::index_type>(ring));
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * The snapshot contains the counters, all rings in order and the
+ * unconnected start and end nodes referencing the rings by their index.
+ */
+void CoastlineRingCollection::write_snapshot(const std::string& filename) const {
+    assert(m_num_removed == 0);
+    SnapshotWriter writer{filename};
+
+    writer.write<uint64_t>(m_ways);
+    writer.write<uint64_t>(m_rings_from_single_way);
+    writer.write<uint64_t>(m_fixed_rings);
+    writer.write<uint64_t>(m_rings.size());
+
+    for (const auto& ring : m_rings) {
+        ring.write_snapshot(writer);
+    }
+
+    write_end_nodes(writer, m_start_nodes);
+    write_end_nodes(writer, m_end_nodes);
+
+    writer.close();
+}
+
+void CoastlineRingCollection::read_snapshot(const std::string& filename) {
+    assert(m_rings.empty());
+    SnapshotReader reader{filename};
+
+    m_ways = reader.read<uint64_t>();
+    m_rings_from_single_way = reader.read<uint64_t>();
+    m_fixed_rings = reader.read<uint64_t>();
+    const auto size = reader.read<uint64_t>();
+    if (size >= IdIndexMap::not_found) {
+        throw std::runtime_error{"Snapshot file '" + filename + "' is corrupted"};
+    }
+
+    m_rings.reserve(size);
+    for (uint64_t n = 0; n < size; ++n) {
+        add_ring(CoastlineRing{reader});
+    }
+
+    read_end_nodes(reader, m_start_nodes, size);
+    read_end_nodes(reader, m_end_nodes, size);
+
+    if (!reader.eof()) {
+        throw std::runtime_error{"Snapshot file '" + filename + "' is corrupted"};
+    }
+}
+
+namespace {
+
+// Number of rings converted into polygons in one task in the thread pool.
+constexpr const std::size_t rings_per_polygon_task = 1024;
+
 bool is_valid_polygon(const OGRGeometry* geometry) {
     if (geometry && geometry->getGeometryType() == wkbPolygon && !geometry->IsEmpty()) {
         const auto *const polygon = static_cast<const OGRPolygon*>(geometry);
@@ -143,53 +418,111 @@ bool is_valid_polygon(const OGRGeometry* geometry) {
     return false;
 }
 
-} // anonymous namespace
+struct polygon_chunk {
+    polygon_vector_type polygons;
 
-std::vector<OGRGeometry*> CoastlineRingCollection::add_polygons_to_vector() {
-    std::vector<OGRGeometry*> vector;
-    vector.reserve(m_list.size());
+    // Number of rings already known to be valid from output_rings().
+    unsigned int skipped_checks = 0;
 
-    for (const auto& ring : m_list) {
-        if (ring->is_closed() && ring->npoints() > 3) { // everything that doesn't match here is bad beyond repair and reported elsewhere
-            std::unique_ptr<OGRPolygon> p = ring->ogr_polygon(m_factory, true);
-            if (p->IsValid()) {
+    // IDs of rings that could not be made into a valid polygon.
+    std::vector<osmium::object_id_type> ignored;
+};
+
+/**
+ * Create valid polygons from the rings [begin, end). This runs in the
+ * thread pool, so it uses its own geometry factory. OGR creates a GEOS
+ * context for each IsValid() and Buffer() call, so those can run in
+ * several threads at the same time. Rings already known to be valid
+ * are not checked again.
+ */
+polygon_chunk make_polygons(const std::vector<CoastlineRing>& rings, std::size_t begin, std::size_t end) {
+    osmium::geom::OGRFactory<> factory;
+    polygon_chunk chunk;
+
+    for (std::size_t n = begin; n < end; ++n) {
+        const CoastlineRing& ring = rings[n];
+        if (ring.is_closed() && ring.npoints() > 3) { // everything that doesn't match here is bad beyond repair and reported elsewhere
+            std::unique_ptr<OGRPolygon> p = ring.ogr_polygon(factory, true);
+            if (ring.is_known_valid()) {
+                ++chunk.skipped_checks;
+            }
+            if (ring.is_known_valid() || p->IsValid()) {
                 p->assignSpatialReference(srs.wgs84());
-                vector.push_back(p.release());
+                chunk.polygons.emplace_back(std::move(p), validity::ring);
             } else {
                 std::unique_ptr<OGRGeometry> geom{p->Buffer(0)};
                 if (is_valid_polygon(geom.get())) {
                     geom->assignSpatialReference(srs.wgs84());
-                    vector.push_back(geom.release());
+                    chunk.polygons.emplace_back(static_cast_unique_ptr<OGRPolygon>(std::move(geom)), validity::ring);
                 } else {
-                    std::cerr << "Ignoring invalid polygon geometry (ring_id=" << ring->ring_id() << ").\n";
+                    chunk.ignored.push_back(ring.ring_id());
                 }
             }
         }
     }
 
+    return chunk;
+}
+
+} // anonymous namespace
+
+polygon_vector_type CoastlineRingCollection::add_polygons_to_vector(unsigned int* skipped_checks) {
+    // The rings are converted in chunks in parallel, the results are
+    // collected in the order of the rings.
+    std::vector<std::future<polygon_chunk>> futures;
+    futures.reserve(m_rings.size() / rings_per_polygon_task + 1);
+    for (std::size_t begin = 0; begin < m_rings.size(); begin += rings_per_polygon_task) {
+        const std::size_t end = std::min(begin + rings_per_polygon_task, m_rings.size());
+        futures.push_back(osmium::thread::Pool::default_instance().submit([this, begin, end]() {
+            return make_polygons(m_rings, begin, end);
+        }));
+    }
+
+    // Wait for all tasks before get() can throw, they reference the rings.
+    for (const auto& future : futures) {
+        future.wait();
+    }
+
+    polygon_vector_type vector;
+    vector.reserve(m_rings.size());
+
+    for (auto& future : futures) {
+        polygon_chunk chunk = future.get();
+        std::move(chunk.polygons.begin(), chunk.polygons.end(), std::back_inserter(vector));
+        *skipped_checks += chunk.skipped_checks;
+        for (const auto ring_id : chunk.ignored) {
+            std::cerr << "Ignoring invalid polygon geometry (ring_id=" << ring_id << ").\n";
+        }
+    }
+
     return vector;
 }
 
 unsigned int CoastlineRingCollection::output_rings(OutputDatabase& output) {
     unsigned int warnings = 0;
 
-    for (const auto& ring : m_list) {
-        if (ring->is_closed()) {
-            if (ring->npoints() > 3) {
-                output.add_ring(ring->ogr_polygon(m_factory, true), ring->ring_id(), ring->nways(), ring->npoints(), ring->is_fixed());
-            } else if (ring->npoints() == 1) {
-                output.add_error_point(ring->ogr_first_point(), "single_point_in_ring", ring->first_node_id());
+    for (auto& ring : m_rings) {
+        if (ring.is_closed()) {
+            if (ring.npoints() > 3) {
+                const bool valid = output.add_ring(ring.ogr_polygon(m_factory, true), ring.ring_id(), ring.nways(), ring.npoints(), ring.is_fixed());
+                // The check was done in the output SRS, it only tells us
+                // something about the polygon we create later in WGS84.
+                if (srs.is_wgs84()) {
+                    ring.set_known_valid(valid);
+                }
+            } else if (ring.npoints() == 1) {
+                output.add_error_point(ring.ogr_first_point(), "single_point_in_ring", ring.first_node_id());
                 warnings++;
-            } else { // ring->npoints() == 2 or 3
-                output.add_error_line(ring->ogr_linestring(m_factory, true), "not_a_ring", ring->ring_id());
-                output.add_error_point(ring->ogr_first_point(), "not_a_ring", ring->first_node_id());
-                output.add_error_point(ring->ogr_last_point(), "not_a_ring", ring->last_node_id());
+            } else { // ring.npoints() == 2 or 3
+                output.add_error_line(ring.ogr_linestring(m_factory, true), "not_a_ring", ring.ring_id());
+                output.add_error_point(ring.ogr_first_point(), "not_a_ring", ring.first_node_id());
+                output.add_error_point(ring.ogr_last_point(), "not_a_ring", ring.last_node_id());
                 warnings++;
             }
         } else {
-            output.add_error_line(ring->ogr_linestring(m_factory, true), "not_closed", ring->ring_id());
-            output.add_error_point(ring->ogr_first_point(), "end_point", ring->first_node_id());
-            output.add_error_point(ring->ogr_last_point(), "end_point", ring->last_node_id());
+            output.add_error_line(ring.ogr_linestring(m_factory, true), "not_closed", ring.ring_id());
+            output.add_error_point(ring.ogr_first_point(), "end_point", ring.first_node_id());
+            output.add_error_point(ring.ogr_last_point(), "end_point", ring.last_node_id());
             warnings++;
         }
     }
@@ -199,127 +532,364 @@ unsigned int CoastlineRingCollection::output_rings(OutputDatabase& output) {
 
 namespace {
 
-osmium::Location intersection(const osmium::Segment& s1, const osmium::Segment&s2) {
-    if (s1.first()  == s2.first()  ||
-        s1.first()  == s2.second() ||
-        s1.second() == s2.first()  ||
-        s1.second() == s2.second()) {
-        return osmium::Location{};
+int32_t min_y(const osmium::UndirectedSegment& segment) noexcept {
+    return std::min(segment.first().y(), segment.second().y());
+}
+
+int32_t max_y(const osmium::UndirectedSegment& segment) noexcept {
+    return std::max(segment.first().y(), segment.second().y());
+}
+
+std::unique_ptr<OGRLineString> create_ogr_linestring(const osmium::Segment& segment) {
+    auto line = std::make_unique<OGRLineString>();
+    line->setNumPoints(2);
+    line->setPoint(0, segment.first().lon(), segment.first().lat());
+    line->setPoint(1, segment.second().lon(), segment.second().lat());
+    line->setCoordinateDimension(2);
+
+    return line;
+}
+
+// Number of rings looked up in the problem segments in one task in the
+// thread pool.
+const std::size_t rings_per_segment_task = 1024;
+
+/**
+ * Overlap or intersection found between the segments with the indexes
+ * first and second in the sorted segments. For overlaps the (first)
+ * segment is kept for the error output.
+ */
+struct segment_pair {
+    std::size_t first;
+    std::size_t second;
+    osmium::UndirectedSegment segment;
+    osmium::Location intersection;
+    bool overlap;
+};
+
+bool operator<(const segment_pair& a, const segment_pair& b) noexcept {
+    return std::make_pair(a.first, a.second) < std::make_pair(b.first, b.second);
+}
+
+/**
+ * The result of the sweep over all segments or one slab. Besides the
+ * overlaps and intersections reported as errors this has all segments
+ * that could make the polygon of the ring they are in invalid: The
+ * segments in those overlaps and intersections, collinear segments
+ * overlapping each other and segments sharing an end point with more
+ * than one other segment. Rings without any of them are valid.
+ */
+struct sweep_result {
+    std::vector<segment_pair> found;
+
+    // Sorted and without duplicates.
+    std::vector<osmium::UndirectedSegment> problem_segments;
+};
+
+/**
+ * Sweep line going through the segments in the order of their first x
+ * coordinate finding overlaps and intersections. The active segments,
+ * those reaching the current x coordinate, are kept in an interval tree
+ * on their y range, so each segment is only compared to the active
+ * segments overlapping it in y. Segments are removed from the active set
+ * when the sweep line moves past their second x coordinate.
+ *
+ * Copies of the active segments are kept here, so the segments don't have
+ * to be in memory all at the same time.
+ */
+class segment_sweep {
+
+    struct active_segment {
+        osmium::UndirectedSegment segment;
+        std::size_t index;
+    };
+
+    IntervalTree m_active;
+
+    // The values in the interval tree are indexes into this vector.
+    std::vector<active_segment> m_slots;
+    std::vector<std::size_t> m_free_slots;
+
+    // Min-heap of (second x coordinate, tree handle, slot).
+    using expiry = std::tuple<int32_t, IntervalTree::handle_type, std::size_t>;
+    std::priority_queue<expiry, std::vector<expiry>, std::greater<expiry>> m_expiries;
+
+    // The candidates found in the active set are tested together.
+    std::vector<std::size_t> m_candidates;
+    SegmentBatch m_batch;
+    std::vector<uint8_t> m_intersecting;
+
+    std::vector<segment_pair> m_found;
+    std::vector<osmium::UndirectedSegment> m_problem_segments;
+
+    static bool has_end_point(const osmium::UndirectedSegment& segment, const osmium::Location& location) noexcept {
+        return segment.first() == location || segment.second() == location;
     }
 
-    const double denom = ((s2.second().lat() - s2.first().lat())*(s1.second().lon() - s1.first().lon())) -
-                         ((s2.second().lon() - s2.first().lon())*(s1.second().lat() - s1.first().lat()));
+    void add_problem(const osmium::UndirectedSegment& s1, const osmium::UndirectedSegment& s2) {
+        m_problem_segments.push_back(s1);
+        m_problem_segments.push_back(s2);
+    }
 
-    if (denom != 0) {
-        const double nume_a = ((s2.second().lon() - s2.first().lon())*(s1.first().lat() - s2.first().lat())) -
-                              ((s2.second().lat() - s2.first().lat())*(s1.first().lon() - s2.first().lon()));
+public:
 
-        const double nume_b = ((s1.second().lon() - s1.first().lon())*(s1.first().lat() - s2.first().lat())) -
-                              ((s1.second().lat() - s1.first().lat())*(s1.first().lon() - s2.first().lon()));
+    /**
+     * Add a segment to the active set without checking it. Used for
+     * segments from earlier slabs.
+     */
+    void activate(std::size_t index, const osmium::UndirectedSegment& segment) {
+        std::size_t slot = m_slots.size();
+        if (m_free_slots.empty()) {
+            m_slots.push_back(active_segment{segment, index});
+        } else {
+            slot = m_free_slots.back();
+            m_free_slots.pop_back();
+            m_slots[slot] = active_segment{segment, index};
+        }
+        m_expiries.emplace(segment.second().x(), m_active.insert(min_y(segment), max_y(segment), slot), slot);
+    }
 
-        if ((denom > 0 && nume_a >= 0 && nume_a <= denom && nume_b >= 0 && nume_b <= denom) ||
-            (denom < 0 && nume_a <= 0 && nume_a >= denom && nume_b <= 0 && nume_b >= denom)) {
-            const double ua = nume_a / denom;
-            const double ix = s1.first().lon() + (ua * (s1.second().lon() - s1.first().lon()));
-            const double iy = s1.first().lat() + (ua * (s1.second().lat() - s1.first().lat()));
-            return {ix, iy};
+    /**
+     * Check the next segment in sorted order against the active segments
+     * and add it to the active set.
+     */
+    void add(std::size_t index, const osmium::UndirectedSegment& segment) {
+        while (!m_expiries.empty() && std::get<0>(m_expiries.top()) < segment.first().x()) {
+            m_active.erase(std::get<1>(m_expiries.top()));
+            m_free_slots.push_back(std::get<2>(m_expiries.top()));
+            m_expiries.pop();
         }
+
+        m_candidates.clear();
+        m_batch.clear();
+        m_active.query(min_y(segment), max_y(segment), [&](std::size_t slot) {
+            m_candidates.push_back(slot);
+            m_batch.push_back(m_slots[slot].segment);
+        });
+
+        if (!m_candidates.empty()) {
+            segments_intersect(segment, m_batch, &m_intersecting);
+            unsigned int at_first = 0;
+            unsigned int at_second = 0;
+            for (std::size_t n = 0; n < m_candidates.size(); ++n) {
+                const active_segment& other = m_slots[m_candidates[n]];
+                if (other.segment == segment) {
+                    m_found.push_back(segment_pair{other.index, index, segment, osmium::Location{}, true});
+                    add_problem(other.segment, segment);
+                } else if (m_intersecting[n]) {
+                    m_found.push_back(segment_pair{other.index, index, segment, intersection_location(other.segment, segment), false});
+                    add_problem(other.segment, segment);
+                } else if (segments_overlap(other.segment, segment)) {
+                    add_problem(other.segment, segment);
+                }
+                at_first += has_end_point(other.segment, segment.first()) ? 1 : 0;
+                at_second += has_end_point(other.segment, segment.second()) ? 1 : 0;
+            }
+
+            // In a ring each end point is shared by two segments. All
+            // segments sharing an end point are active when the last of
+            // them is added, so this finds all points shared by more.
+            if (at_first > 1 || at_second > 1) {
+                for (const auto slot : m_candidates) {
+                    const auto& other = m_slots[slot].segment;
+                    if ((at_first > 1 && has_end_point(other, segment.first())) ||
+                        (at_second > 1 && has_end_point(other, segment.second()))) {
+                        add_problem(other, segment);
+                    }
+                }
+            }
+        }
+
+        activate(index, segment);
     }
 
-    return osmium::Location{};
-}
+    /// The overlaps, intersections and problem segments found, sorted.
+    sweep_result result() {
+        std::sort(m_found.begin(), m_found.end());
+        std::sort(m_problem_segments.begin(), m_problem_segments.end());
+        m_problem_segments.erase(std::unique(m_problem_segments.begin(), m_problem_segments.end()), m_problem_segments.end());
+        return sweep_result{std::move(m_found), std::move(m_problem_segments)};
+    }
 
-bool outside_x_range(const osmium::UndirectedSegment& s1, const osmium::UndirectedSegment& s2) {
-    return s1.first().x() > s2.second().x();
-}
+}; // class segment_sweep
+
+/**
+ * A slab is a range [begin, end) of the sorted segments. All segments
+ * starting at the same x coordinate are in the same slab. The extra
+ * segments are those from earlier slabs reaching into the x range of
+ * this slab.
+ */
+struct slab {
+    std::size_t begin;
+    std::size_t end;
+    std::vector<std::size_t> extra;
+};
+
+/**
+ * Split the sorted segments into (at most) num_slabs slabs with about the
+ * same number of segments and find the extra segments for each slab.
+ */
+std::vector<slab> make_slabs(const std::vector<osmium::UndirectedSegment>& segments, std::size_t num_slabs) {
+    std::vector<slab> slabs;
+    std::vector<int32_t> slab_start_x;
+
+    std::size_t begin = 0;
+    for (std::size_t n = 1; n <= num_slabs && begin < segments.size(); ++n) {
+        std::size_t end = n == num_slabs ? segments.size() : segments.size() * n / num_slabs;
+        while (end < segments.size() && end > begin && segments[end].first().x() == segments[end - 1].first().x()) {
+            ++end;
+        }
+        if (end > begin) {
+            slabs.push_back(slab{begin, end, {}});
+            slab_start_x.push_back(segments[begin].first().x());
+            begin = end;
+        }
+    }
 
-bool y_range_overlap(const osmium::UndirectedSegment& s1, const osmium::UndirectedSegment& s2) {
-    const int tmin = s1.first().y() < s1.second().y() ? s1.first().y( ) : s1.second().y();
-    const int tmax = s1.first().y() < s1.second().y() ? s1.second().y() : s1.first().y();
-    const int omin = s2.first().y() < s2.second().y() ? s2.first().y()  : s2.second().y();
-    const int omax = s2.first().y() < s2.second().y() ? s2.second().y() : s2.first().y();
+    std::size_t current = 0;
+    for (std::size_t i = 0; i < segments.size(); ++i) {
+        if (i == slabs[current].end) {
+            ++current;
+        }
+        const auto last = static_cast<std::size_t>(std::upper_bound(slab_start_x.cbegin(), slab_start_x.cend(), segments[i].second().x()) - slab_start_x.cbegin());
+        for (std::size_t k = current + 1; k < last; ++k) {
+            slabs[k].extra.push_back(i);
+        }
+    }
 
-    return tmin <= omax && omin <= tmax;
+    return slabs;
 }
 
-std::unique_ptr<OGRLineString> create_ogr_linestring(const osmium::Segment& segment) {
-    auto line = std::make_unique<OGRLineString>();
-    line->setNumPoints(2);
-    line->setPoint(0, segment.first().lon(), segment.first().lat());
-    line->setPoint(1, segment.second().lon(), segment.second().lat());
-    line->setCoordinateDimension(2);
+/**
+ * Find all overlaps and intersections between pairs of segments where the
+ * second segment is in the slab. Together with the extra segments this
+ * finds exactly the pairs a sweep over all segments would find for the
+ * segments in the slab. The result is sorted.
+ */
+sweep_result find_intersections_in_slab(const std::vector<osmium::UndirectedSegment>& segments, const slab& s) {
+    segment_sweep sweep;
 
-    return line;
+    for (const auto i : s.extra) {
+        sweep.activate(i, segments[i]);
+    }
+
+    for (std::size_t j = s.begin; j < s.end; ++j) {
+        sweep.add(j, segments[j]);
+    }
+
+    return sweep.result();
 }
 
 } // anonymous namespace
 
 /**
  * Checks if there are intersections between any coastline segments.
- * Returns the number of intersections and overlaps.
+ * Returns the number of intersections and overlaps. Rings without any
+ * problems found here are marked as known to be valid, so their polygons
+ * don't have to be checked again. If the segments are checked in memory,
+ * they are split into slabs of at least min_segments_per_slab segments.
+ * Otherwise the sorted runs are written to temporary files in temp_dir.
  */
-unsigned int CoastlineRingCollection::check_for_intersections(OutputDatabase& output, int segments_fd) {
+unsigned int CoastlineRingCollection::check_for_intersections(OutputDatabase& output, SegmentFileWriter* segment_writer, std::size_t max_segments_in_memory, std::size_t min_segments_per_slab, const std::string& temp_dir) {
     unsigned int overlaps = 0;
 
-    std::vector<osmium::UndirectedSegment> segments;
+    SegmentRuns runs{max_segments_in_memory, temp_dir};
     if (debug) {
         std::cerr << "Setting up segments...\n";
     }
 
-    for (const auto& ring : m_list) {
-        ring->add_segments_to_vector(segments);
+    for (const auto& ring : m_rings) {
+        ring.for_each_segment([&runs](const osmium::UndirectedSegment& segment) {
+            runs.add(segment);
+        });
     }
 
     if (debug) {
         std::cerr << "Sorting...\n";
     }
 
-    std::sort(segments.begin(), segments.end());
+    runs.finish();
 
-    if (segments_fd >= 0) {
+    sweep_result result;
+    if (runs.spilled()) {
         if (debug) {
-            std::cerr << "Writing segments to file...\n";
+            std::cerr << "Merging " << runs.num_runs() << " sorted runs of segments from temporary files and finding intersections...\n";
         }
 
-        const auto length = segments.size() * sizeof(osmium::UndirectedSegment);
-#ifndef _MSC_VER
-        if (::write(segments_fd, segments.data(), length) != static_cast<ssize_t>(length)) {
-#else
-        if (_write(segments_fd, segments.data(), length) != static_cast<int>(length)) {
-#endif
-            throw std::runtime_error{"Write error"};
+        // The merged segments are written out and checked in one
+        // (serial) sweep without having all of them in memory.
+        segment_sweep sweep;
+        std::size_t index = 0;
+        runs.merge([&](const std::vector<osmium::UndirectedSegment>& chunk) {
+            if (segment_writer) {
+                segment_writer->add(chunk);
+            }
+            for (const auto& segment : chunk) {
+                sweep.add(index++, segment);
+            }
+        });
+        result = sweep.result();
+    } else {
+        const auto& segments = runs.segments();
+
+        if (segment_writer) {
+            if (debug) {
+                std::cerr << "Writing segments to file...\n";
+            }
+            segment_writer->add(segments);
         }
-    }
 
-    // There can be no intersections if there are less than two segments
-    if (segments.size() < 2) {
-        return 0;
-    }
+        // There can be no intersections if there are less than two segments
+        if (segments.size() < 2) {
+            return 0;
+        }
 
-    if (debug) {
-        std::cerr << "Finding intersections...\n";
+        if (debug) {
+            std::cerr << "Finding intersections...\n";
+        }
+
+        // The sorted segments are split into slabs which are checked in
+        // parallel. The results are merged in the order of a serial check.
+        const auto num_slabs = std::min(static_cast<std::size_t>(osmium::thread::Pool::default_instance().num_threads()) * 4,
+                                        segments.size() / min_segments_per_slab);
+        const auto slabs = make_slabs(segments, std::max(num_slabs, static_cast<std::size_t>(1)));
+
+        if (slabs.size() == 1) {
+            result = find_intersections_in_slab(segments, slabs.front());
+        } else {
+            std::vector<std::future<sweep_result>> futures;
+            futures.reserve(slabs.size());
+            for (const auto& s : slabs) {
+                futures.push_back(osmium::thread::Pool::default_instance().submit([&segments, &s]() {
+                    return find_intersections_in_slab(segments, s);
+                }));
+            }
+            // Wait for all tasks before get() can throw, they reference the segments.
+            for (const auto& future : futures) {
+                future.wait();
+            }
+            for (auto& future : futures) {
+                auto slab_result = future.get();
+                result.found.insert(result.found.end(), slab_result.found.begin(), slab_result.found.end());
+                result.problem_segments.insert(result.problem_segments.end(), slab_result.problem_segments.begin(), slab_result.problem_segments.end());
+            }
+            std::sort(result.found.begin(), result.found.end());
+            auto& problems = result.problem_segments;
+            std::sort(problems.begin(), problems.end());
+            problems.erase(std::unique(problems.begin(), problems.end()), problems.end());
+        }
     }
 
+    mark_known_valid_rings(result.problem_segments);
+
     std::vector<osmium::Location> intersections;
-    for (auto it1 = segments.cbegin(); it1 != segments.cend() - 1; ++it1) {
-        const osmium::UndirectedSegment& s1 = *it1;
-        for (auto it2 = it1 + 1; it2 != segments.cend(); ++it2) {
-            const osmium::UndirectedSegment& s2 = *it2;
-            if (s1 == s2) {
-                std::unique_ptr<OGRLineString> line = create_ogr_linestring(s1);
-                output.add_error_line(std::move(line), "overlap");
-                overlaps++;
-            } else {
-                if (outside_x_range(s2, s1)) {
-                    break;
-                }
-                if (y_range_overlap(s1, s2)) {
-                    const auto i = intersection(s1, s2);
-                    if (i) {
-                        intersections.push_back(i);
-                    }
-                }
-            }
+    for (const auto& pair : result.found) {
+        if (pair.overlap) {
+            std::unique_ptr<OGRLineString> line = create_ogr_linestring(pair.segment);
+            output.add_error_line(std::move(line), "overlap");
+            overlaps++;
+        } else {
+            intersections.push_back(pair.intersection);
         }
     }
 
@@ -331,17 +901,39 @@ unsigned int CoastlineRingCollection::check_for_intersections(OutputDatabase& ou
     return intersections.size() + overlaps;
 }
 
+void CoastlineRingCollection::mark_known_valid_rings(const std::vector<osmium::UndirectedSegment>& problem_segments) {
+    // Each task only changes its own rings.
+    std::vector<std::future<void>> futures;
+    futures.reserve(m_rings.size() / rings_per_segment_task + 1);
+    for (std::size_t begin = 0; begin < m_rings.size(); begin += rings_per_segment_task) {
+        const std::size_t end = std::min(begin + rings_per_segment_task, m_rings.size());
+        futures.push_back(osmium::thread::Pool::default_instance().submit([this, &problem_segments, begin, end]() {
+            for (std::size_t n = begin; n < end; ++n) {
+                m_rings[n].set_known_valid(!m_rings[n].contains_any_segment(problem_segments));
+            }
+        }));
+    }
+
+    // Wait for all tasks before get() can throw, they reference the segments.
+    for (const auto& future : futures) {
+        future.wait();
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
 bool CoastlineRingCollection::close_antarctica_ring(int epsg) {
-    for (const auto& ring : m_list) {
-        const osmium::Location fpos = ring->first_location();
-        const osmium::Location lpos = ring->last_location();
+    for (auto& ring : m_rings) {
+        const osmium::Location fpos = ring.first_location();
+        const osmium::Location lpos = ring.last_location();
         if (fpos.lon() > 179.99 && lpos.lon() < -179.99 &&
             fpos.lat() <  -77.0 && fpos.lat() >  -78.0 &&
             lpos.lat() <  -77.0 && lpos.lat() >  -78.0) {
 
-            m_end_nodes.erase(ring->last_node_id());
-            m_start_nodes.erase(ring->first_node_id());
-            ring->close_antarctica_ring(epsg);
+            m_end_nodes.erase(ring.last_node_id());
+            m_start_nodes.erase(ring.first_node_id());
+            ring.close_antarctica_ring(epsg);
             return true;
         }
     }
@@ -349,42 +941,64 @@ bool CoastlineRingCollection::close_antarctica_ring(int epsg) {
 }
 
 void CoastlineRingCollection::close_rings(OutputDatabase& output, bool debug, double max_distance) {
-    std::vector<Connection> connections;
+    const auto end_nodes = m_end_nodes.sorted_entries();
+    const auto start_nodes = m_start_nodes.sorted_entries();
+
+    // Put all start locations into a grid, so that for each end location
+    // only the start locations nearby have to be looked at. The distance
+    // is the squared distance in degrees.
+    LocationGrid grid{std::sqrt(max_distance)};
+    grid.reserve(start_nodes.size());
+    for (std::size_t n = 0; n < start_nodes.size(); ++n) {
+        grid.add(m_rings[start_nodes[n].second].first_location(), n);
+    }
+    grid.build();
 
-    // Create vector with all possible combinations of connections between rings.
-    for (const auto& end_node : m_end_nodes) {
-        for (const auto& start_node : m_start_nodes) {
-            const double distance = (*start_node.second)->distance_to_start_location((*end_node.second)->last_location());
+    // Find all possible connections between rings.
+    std::vector<Connection> connections;
+    for (std::size_t n = 0; n < end_nodes.size(); ++n) {
+        const osmium::Location end_location = m_rings[end_nodes[n].second].last_location();
+        grid.query(end_location, [&](osmium::Location /*location*/, std::size_t start_node) {
+            const double distance = m_rings[start_nodes[start_node].second].distance_to_start_location(end_location);
             if (distance < max_distance) {
-                connections.emplace_back(distance, end_node.first, start_node.first);
+                connections.emplace_back(distance, n, start_node);
             }
-        }
+        });
     }
 
-    // Sort vector by distance, shortest at end.
-    std::sort(connections.begin(), connections.end(), Connection::sort_by_distance);
+    // Go through the connections starting with the shortest and close
+    // rings using the connections in turn. Once a connection was used,
+    // all other connections using the same end node or the same start
+    // node are invalid, they are skipped when they come up.
+    std::priority_queue<Connection, std::vector<Connection>, std::greater<>> queue{std::greater<>{}, std::move(connections)};
+    std::vector<bool> end_node_used(end_nodes.size());
+    std::vector<bool> start_node_used(start_nodes.size());
 
-    // Go through vector starting with the shortest connections and close rings
-    // using the connections in turn.
-    while (!connections.empty()) {
-        const Connection conn = connections.back();
-        connections.pop_back();
+    while (!queue.empty()) {
+        const Connection conn = queue.top();
+        queue.pop();
 
-        // Invalidate all other connections using one of the same end points.
-        connections.erase(remove_if(connections.begin(), connections.end(), conn), connections.end());
+        if (end_node_used[conn.end_node] || start_node_used[conn.start_node]) {
+            continue;
+        }
+        end_node_used[conn.end_node] = true;
+        start_node_used[conn.start_node] = true;
+
+        const osmium::object_id_type end_id = end_nodes[conn.end_node].first;
+        const osmium::object_id_type start_id = start_nodes[conn.start_node].first;
 
-        const auto eit = m_end_nodes.find(conn.start_id);
-        const auto sit = m_start_nodes.find(conn.end_id);
+        const auto e_index = m_end_nodes.get(end_id);
+        const auto s_index = m_start_nodes.get(start_id);
 
-        if (eit != m_end_nodes.end() && sit != m_start_nodes.end()) {
+        if (e_index != IdIndexMap::not_found && s_index != IdIndexMap::not_found) {
             if (debug) {
-                std::cerr << "Closing ring between node " << conn.end_id << " and node " << conn.start_id << "\n";
+                std::cerr << "Closing ring between node " << start_id << " and node " << end_id << "\n";
             }
 
             m_fixed_rings++;
 
-            CoastlineRing* e = eit->second->get();
-            const CoastlineRing* s = sit->second->get();
+            CoastlineRing* e = &m_rings[e_index];
+            const CoastlineRing* s = &m_rings[s_index];
 
             output.add_error_point(e->ogr_last_point(), "fixed_end_point", e->last_node_id());
             output.add_error_point(s->ogr_first_point(), "fixed_end_point", s->first_node_id());
@@ -400,28 +1014,30 @@ void CoastlineRingCollection::close_rings(OutputDatabase& output, bool debug, do
                 // connect to itself by closing ring
                 e->close_ring();
 
-                m_end_nodes.erase(eit);
-                m_start_nodes.erase(sit);
+                m_end_nodes.erase(end_id);
+                m_start_nodes.erase(start_id);
             } else {
                 // connect to other ring
                 e->join_over_gap(*s);
 
-                m_list.erase(sit->second);
+                remove_ring(s_index);
                 if (e->first_location() == e->last_location()) {
                     output.add_error_point(e->ogr_first_point(), "double_node", e->first_node_id());
                     m_start_nodes.erase(e->first_node_id());
-                    m_end_nodes.erase(eit);
-                    m_start_nodes.erase(sit);
+                    m_end_nodes.erase(end_id);
+                    m_start_nodes.erase(start_id);
                     m_end_nodes.erase(e->last_node_id());
                     e->fake_close();
                 } else {
-                    m_end_nodes[e->last_node_id()] = eit->second;
-                    m_end_nodes.erase(eit);
-                    m_start_nodes.erase(sit);
+                    m_end_nodes.set(e->last_node_id(), e_index);
+                    m_end_nodes.erase(end_id);
+                    m_start_nodes.erase(start_id);
                 }
             }
         }
     }
+
+    compact();
 }
 
 /**
@@ -440,11 +1056,11 @@ unsigned int CoastlineRingCollection::output_questionable(const CoastlinePolygon
     using lcrp_type = std::pair<osmium::Location, CoastlineRing*>;
 
     std::vector<lcrp_type> rings;
-    rings.reserve(m_list.size());
+    rings.reserve(m_rings.size());
 
     // put all rings in a vector...
-    for (const auto& ring : m_list) {
-        rings.emplace_back(ring->first_location(), ring.get());
+    for (auto& ring : m_rings) {
+        rings.emplace_back(ring.first_location(), &ring);
     }
 
     // comparison function that ignores the second part of the pair
@@ -467,10 +1083,10 @@ unsigned int CoastlineRingCollection::output_questionable(const CoastlinePolygon
     }
 
     // find all rings not marked as outer and output them to the error_lines table
-    for (const auto& ring : m_list) {
-        if (!ring->is_outer()) {
-            if (ring->is_closed() && ring->npoints() > 3 && ring->npoints() < max_nodes_to_be_considered_questionable) {
-                output.add_error_line(ring->ogr_linestring(m_factory, false), "questionable", ring->ring_id());
+    for (const auto& ring : m_rings) {
+        if (!ring.is_outer()) {
+            if (ring.is_closed() && ring.npoints() > 3 && ring.npoints() < max_nodes_to_be_considered_questionable) {
+                output.add_error_line(ring.ogr_linestring(m_factory, false), "questionable", ring.ring_id());
                 warnings++;
             }
         }
@@ -22,54 +22,94 @@
 
 */
 
+#include "coastline_polygons.hpp"
 #include "coastline_ring.hpp"
+#include "coordinate_arena.hpp"
+#include "id_index_map.hpp"
 
 #include <osmium/geom/ogr.hpp>
 #include <osmium/osm/way.hpp>
 #include <osmium/osm/types.hpp>
+#include <osmium/osm/undirected_segment.hpp>
 
 #include <cstddef>
-#include <list>
-#include <map>
-#include <memory>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 class OGRGeometry;
 class OutputDatabase;
-class CoastlinePolygons;
-
-using coastline_rings_list_type = std::list<std::shared_ptr<CoastlineRing>>;
-using idmap_type = std::map<osmium::object_id_type, coastline_rings_list_type::iterator>;
+class SegmentFileWriter;
 
 /**
  * A collection of CoastlineRing objects. Keeps a list of all start and end
  * nodes so it can efficiently join CoastlineRings.
+ *
+ * The rings are stored in a vector and referenced by their index in that
+ * vector. When a ring is joined to another ring or removed it is only
+ * marked as removed, compact() then gets rid of those rings while keeping
+ * the order of the other rings.
  */
 class CoastlineRingCollection {
 
-    coastline_rings_list_type m_list;
+    std::vector<CoastlineRing> m_rings;
+
+    // Marks rings in m_rings that were removed.
+    std::vector<bool> m_removed;
+
+    std::size_t m_num_removed = 0;
 
-    // Mapping from node IDs to CoastlineRings.
-    idmap_type m_start_nodes;
-    idmap_type m_end_nodes;
+    // Coordinates of all rings after compact_coordinates().
+    CoordinateArena m_arena;
+
+    // Mapping from node IDs to indexes of CoastlineRings.
+    IdIndexMap m_start_nodes;
+    IdIndexMap m_end_nodes;
 
     unsigned int m_ways = 0;
     unsigned int m_rings_from_single_way = 0;
     unsigned int m_fixed_rings = 0;
 
+    IdIndexMap::index_type add_ring(CoastlineRing&& ring);
+
+    void remove_ring(IdIndexMap::index_type index);
+
+    void compact();
+
+    template <typename TPiece>
+    void add_partial_ring_impl(TPiece& piece);
+
     void add_partial_ring(const osmium::Way& way);
 
+    void add_piece(CoastlineRing& piece);
+
+    /**
+     * Mark all rings that don't contain any of the segments as known to be
+     * valid and all others as not known to be valid. The segments must be
+     * sorted.
+     */
+    void mark_known_valid_rings(const std::vector<osmium::UndirectedSegment>& problem_segments);
+
     osmium::geom::OGRFactory<> m_factory;
 
 public:
 
-    using const_iterator = coastline_rings_list_type::const_iterator;
-
     CoastlineRingCollection() = default;
 
+    // The rings reference m_arena, so this can not be copied or moved.
+    CoastlineRingCollection(const CoastlineRingCollection&) = delete;
+    CoastlineRingCollection& operator=(const CoastlineRingCollection&) = delete;
+
+    CoastlineRingCollection(CoastlineRingCollection&&) = delete;
+    CoastlineRingCollection& operator=(CoastlineRingCollection&&) = delete;
+
+    ~CoastlineRingCollection() noexcept = default;
+
     /// Return the number of CoastlineRings in the collection.
     std::size_t size() const noexcept {
-        return m_list.size();
+        return m_rings.size() - m_num_removed;
     }
 
     /**
@@ -81,7 +121,7 @@ public:
         m_ways++;
         if (way.is_closed()) {
             m_rings_from_single_way++;
-            m_list.push_back(std::make_shared<CoastlineRing>(way));
+            add_ring(CoastlineRing{way});
         } else {
             add_partial_ring(way);
         }
@@ -103,15 +143,79 @@ public:
         return m_fixed_rings;
     }
 
-    void setup_locations(locmap_type& locmap);
+    /**
+     * Must be called after all ways have been added. Materializes all
+     * rings that are not closed and gets rid of rings marked as removed.
+     */
+    void finish_assembly();
+
+    void setup_locations(LocationMap& locmap);
+
+    /**
+     * Remove the specified ways from all rings. Affected rings are split
+     * into pieces made up of the remaining ways which are then joined
+     * again with each other and with other rings where possible. The
+     * locations of the nodes of the removed ways are added to the
+     * locations map unless it already contains those nodes, so they are
+     * available when adding the changed ways again. Returns the number of
+     * affected rings. Call finish_assembly() after this and after adding
+     * any new ways.
+     */
+    std::size_t remove_ways(const std::unordered_set<osmium::object_id_type>& way_ids,
+                            std::unordered_map<osmium::object_id_type, osmium::Location>* locations);
+
+    /**
+     * Set the locations of all nodes in the rings that are in the
+     * locations map. Used for nodes changed in a change file. An invalid
+     * location marks a deleted node.
+     */
+    void update_locations(const std::unordered_map<osmium::object_id_type, osmium::Location>& locations);
+
+    /**
+     * Set the locations in the locmap from the locations of the nodes
+     * already in the rings. Used for nodes of new ways from a change file
+     * that already are in the rings.
+     */
+    void set_locations_from_rings(LocationMap& locmap);
 
     unsigned int check_locations(bool output_missing);
 
-    std::vector<OGRGeometry*> add_polygons_to_vector();
+    /**
+     * Move the node locations of all rings into one coordinate arena and
+     * forget the node IDs not needed any more. Must be called after all
+     * locations are set and before any of the functions below that work
+     * on the geometries. The ways can't be changed and no snapshot can be
+     * written after this.
+     */
+    void compact_coordinates();
+
+    /**
+     * Write all rings and the unconnected end points to a snapshot file.
+     * All node locations must be set.
+     */
+    void write_snapshot(const std::string& filename) const;
+
+    /**
+     * Read rings and unconnected end points from a snapshot file written
+     * by write_snapshot(). The collection must be empty.
+     */
+    void read_snapshot(const std::string& filename);
+
+    /**
+     * Create polygons from all closed rings. Invalid polygons are repaired
+     * with Buffer(0) if possible. The number of validity checks skipped
+     * because check_for_intersections() or output_rings() already found
+     * the ring to be valid is added to skipped_checks.
+     */
+    polygon_vector_type add_polygons_to_vector(unsigned int* skipped_checks);
 
+    /**
+     * Write all rings to the rings layer and remember which of them are
+     * valid, so add_polygons_to_vector() doesn't have to check them again.
+     */
     unsigned int output_rings(OutputDatabase& output);
 
-    unsigned int check_for_intersections(OutputDatabase& output, int segments_fd);
+    unsigned int check_for_intersections(OutputDatabase& output, SegmentFileWriter* segment_writer, std::size_t max_segments_in_memory, std::size_t min_segments_per_slab, const std::string& temp_dir);
 
     bool close_antarctica_ring(int epsg);
 
@@ -121,29 +225,38 @@ public:
 
 private:
 
+    /**
+     * Possible connection between the end node of a ring and the start
+     * node of a ring (which might be the same ring). The nodes are
+     * referenced by their index in the sorted entries of m_end_nodes and
+     * m_start_nodes, respectively.
+     */
     struct Connection {
 
         double distance;
-        osmium::object_id_type start_id;
-        osmium::object_id_type end_id;
+        std::size_t end_node;
+        std::size_t start_node;
 
-        Connection(double d, osmium::object_id_type s, osmium::object_id_type e) :
+        Connection(double d, std::size_t e, std::size_t s) noexcept :
             distance(d),
-            start_id(s),
-            end_id(e) {
+            end_node(e),
+            start_node(s) {
         }
 
         /**
-        * Returns true if start or end ID of this connection is the same as the
-        * other connections start or end ID. Used as predicate in std::remove_if().
-        */
-        bool operator()(const Connection& other) const noexcept {
-            return start_id == other.start_id || end_id == other.end_id;
-        }
-
-        // Used in std::sort
-        static bool sort_by_distance(const Connection& a, const Connection& b) noexcept {
-            return a.distance > b.distance;
+         * Used in std::priority_queue to get the shortest connection
+         * first. Connections with the same distance are ordered by end
+         * node and then start node, so the result doesn't depend on the
+         * order in which the connections were found.
+         */
+        friend bool operator>(const Connection& a, const Connection& b) noexcept {
+            if (a.distance != b.distance) {
+                return a.distance > b.distance;
+            }
+            if (a.end_node != b.end_node) {
+                return a.end_node > b.end_node;
+            }
+            return a.start_node > b.start_node;
         }
 
     }; // struct Connection
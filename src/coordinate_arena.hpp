@@ -0,0 +1,91 @@
+#ifndef COORDINATE_ARENA_HPP
+#define COORDINATE_ARENA_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Storage for the coordinates of all coastline rings once the node
+ * locations are known. The x and y coordinates are kept in two separate
+ * arrays, each ring uses a contiguous range in those arrays.
+ */
+class CoordinateArena {
+
+    std::vector<int32_t> m_x;
+    std::vector<int32_t> m_y;
+
+public:
+
+    CoordinateArena() = default;
+
+    std::size_t size() const noexcept {
+        return m_x.size();
+    }
+
+    void reserve(std::size_t size) {
+        m_x.reserve(size);
+        m_y.reserve(size);
+    }
+
+    void push_back(osmium::Location location) {
+        m_x.push_back(location.x());
+        m_y.push_back(location.y());
+    }
+
+    int32_t x(std::size_t n) const noexcept {
+        assert(n < m_x.size());
+        return m_x[n];
+    }
+
+    int32_t y(std::size_t n) const noexcept {
+        assert(n < m_y.size());
+        return m_y[n];
+    }
+
+    osmium::Location location(std::size_t n) const noexcept {
+        return osmium::Location{x(n), y(n)};
+    }
+
+    /**
+     * Copy the size coordinates starting at offset to the end of the
+     * arena. Used when coordinates have to be added to a ring that is
+     * not at the end. Returns the new offset.
+     */
+    std::size_t copy_to_end(std::size_t offset, std::size_t size) {
+        assert(offset + size <= m_x.size());
+        const std::size_t new_offset = m_x.size();
+        for (std::size_t n = offset; n < offset + size; ++n) {
+            m_x.push_back(m_x[n]);
+            m_y.push_back(m_y[n]);
+        }
+        return new_offset;
+    }
+
+}; // class CoordinateArena
+
+#endif // COORDINATE_ARENA_HPP
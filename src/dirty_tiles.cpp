@@ -0,0 +1,155 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "dirty_tiles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr const double pi = 3.14159265358979323846;
+
+// Latitude of the north and south edges of the Web Mercator grid.
+constexpr const double max_mercator_lat = 85.0511287798066;
+
+double deg_to_rad(double degree) noexcept {
+    return degree * pi / 180.0;
+}
+
+double rad_to_deg(double radians) noexcept {
+    return radians * 180.0 / pi;
+}
+
+} // anonymous namespace
+
+DirtyTiles::DirtyTiles(uint32_t zoom, int epsg) :
+    m_zoom(zoom),
+    m_epsg(epsg) {
+    if (zoom > max_zoom) {
+        throw std::invalid_argument{"Zoom level must be between 0 and " + std::to_string(max_zoom)};
+    }
+    m_height = static_cast<double>(1ULL << zoom);
+    if (epsg == 3857) {
+        m_width = m_height;
+    } else if (epsg == 4326) {
+        m_width = 2.0 * m_height;
+    } else {
+        throw std::invalid_argument{"Tile grid SRS must be 3857 or 4326"};
+    }
+}
+
+DirtyTiles::point DirtyTiles::to_grid(const osmium::Location& location) const noexcept {
+    const double x = (location.lon() + 180.0) / 360.0 * m_width;
+    if (m_epsg == 4326) {
+        return point{x, (90.0 - location.lat()) / 180.0 * m_height};
+    }
+
+    const double lat = std::max(-max_mercator_lat, std::min(max_mercator_lat, location.lat()));
+    const double y = std::log(std::tan(pi / 4.0 + deg_to_rad(lat) / 2.0));
+    return point{x, (1.0 - y / pi) / 2.0 * m_height};
+}
+
+DirtyTiles::tile DirtyTiles::to_tile(const point& p) const noexcept {
+    const auto clamp = [](double value, double size) {
+        return static_cast<uint32_t>(std::max(0.0, std::min(size - 1.0, std::floor(value))));
+    };
+    return tile{clamp(p.x, m_width), clamp(p.y, m_height)};
+}
+
+void DirtyTiles::count(const tile& t, bool added) {
+    auto& c = m_tiles[t];
+    if (added) {
+        ++c.added;
+    } else {
+        ++c.removed;
+    }
+}
+
+/**
+ * Walk along the segment through the grid cells (Amanatides and Woo, "A
+ * Fast Voxel Traversal Algorithm for Ray Tracing"). The number of steps
+ * is fixed in advance, so rounding errors can't lead to an endless loop.
+ */
+void DirtyTiles::add(const osmium::UndirectedSegment& segment, bool added) {
+    const point a = to_grid(segment.first());
+    const point b = to_grid(segment.second());
+
+    tile current = to_tile(a);
+    const tile last = to_tile(b);
+
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const int step_x = last.x > current.x ? 1 : -1;
+    const int step_y = last.y > current.y ? 1 : -1;
+
+    constexpr const double infinity = std::numeric_limits<double>::infinity();
+    const double delta_x = dx == 0.0 ? infinity : std::abs(1.0 / dx);
+    const double delta_y = dy == 0.0 ? infinity : std::abs(1.0 / dy);
+    double next_x = dx == 0.0 ? infinity : (step_x > 0 ? (current.x + 1.0 - a.x) : (a.x - current.x)) * delta_x;
+    double next_y = dy == 0.0 ? infinity : (step_y > 0 ? (current.y + 1.0 - a.y) : (a.y - current.y)) * delta_y;
+
+    auto steps = std::abs(static_cast<int64_t>(last.x) - current.x) +
+                 std::abs(static_cast<int64_t>(last.y) - current.y);
+
+    for (; steps > 0; --steps) {
+        count(current, added);
+        if ((next_x < next_y && current.x != last.x) || current.y == last.y) {
+            current.x += step_x;
+            next_x += delta_x;
+        } else {
+            current.y += step_y;
+            next_y += delta_y;
+        }
+    }
+    count(current, added);
+}
+
+void DirtyTiles::bounds(const tile& t, osmium::Location* bottom_left, osmium::Location* top_right) const {
+    const double left = t.x / m_width * 360.0 - 180.0;
+    const double right = (t.x + 1) / m_width * 360.0 - 180.0;
+
+    double top = 0.0;
+    double bottom = 0.0;
+    if (m_epsg == 4326) {
+        top = 90.0 - t.y / m_height * 180.0;
+        bottom = 90.0 - (t.y + 1) / m_height * 180.0;
+    } else {
+        top = rad_to_deg(std::atan(std::sinh(pi * (1.0 - 2.0 * t.y / m_height))));
+        bottom = rad_to_deg(std::atan(std::sinh(pi * (1.0 - 2.0 * (t.y + 1) / m_height))));
+    }
+
+    *bottom_left = osmium::Location{left, bottom};
+    *top_right = osmium::Location{right, top};
+}
+
+void DirtyTiles::write(std::ostream& out) const {
+    for (const auto& entry : m_tiles) {
+        out << m_zoom << '/' << entry.first.x << '/' << entry.first.y << ' '
+            << entry.second.removed << ' ' << entry.second.added << '\n';
+    }
+}
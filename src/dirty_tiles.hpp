@@ -0,0 +1,118 @@
+#ifndef DIRTY_TILES_HPP
+#define DIRTY_TILES_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+
+/**
+ * Tiles touched by changed segments.
+ *
+ * The tile grid is either the usual Web Mercator (EPSG:3857) grid with
+ * 2^zoom x 2^zoom tiles or a WGS84 (EPSG:4326) grid with 2^(zoom+1) x
+ * 2^zoom tiles of the same size in degrees. In both cases tile (0, 0) is
+ * in the north-west corner.
+ *
+ * Each segment is counted in all tiles it goes through. For the Mercator
+ * grid the segment is a straight line in Mercator coordinates like in the
+ * output of osmcoastline. Locations north or south of the Mercator grid
+ * are clamped to its edge.
+ */
+class DirtyTiles {
+
+public:
+
+    struct tile {
+
+        uint32_t x;
+        uint32_t y;
+
+        friend bool operator<(const tile& a, const tile& b) noexcept {
+            return a.y < b.y || (a.y == b.y && a.x < b.x);
+        }
+
+    }; // struct tile
+
+    struct counts {
+        uint64_t removed;
+        uint64_t added;
+    };
+
+private:
+
+    std::map<tile, counts> m_tiles;
+    uint32_t m_zoom;
+    int m_epsg;
+    double m_width;
+    double m_height;
+
+    struct point {
+        double x;
+        double y;
+    };
+
+    /// Position of the location in units of tiles.
+    point to_grid(const osmium::Location& location) const noexcept;
+
+    tile to_tile(const point& p) const noexcept;
+
+    void count(const tile& t, bool added);
+
+public:
+
+    /// Maximum zoom level supported.
+    static constexpr const uint32_t max_zoom = 30;
+
+    /**
+     * Constructor. The epsg code must be 3857 or 4326, the zoom level not
+     * larger than max_zoom.
+     */
+    DirtyTiles(uint32_t zoom, int epsg);
+
+    /// Count the segment in all tiles it goes through.
+    void add(const osmium::UndirectedSegment& segment, bool added);
+
+    uint32_t zoom() const noexcept {
+        return m_zoom;
+    }
+
+    /// The tiles touched with their counts, ordered by y, then x.
+    const std::map<tile, counts>& tiles() const noexcept {
+        return m_tiles;
+    }
+
+    /// Bounds of the tile in WGS84 coordinates.
+    void bounds(const tile& t, osmium::Location* bottom_left, osmium::Location* top_right) const;
+
+    /**
+     * Write the tiles as text, one tile per line: "ZOOM/X/Y REMOVED ADDED".
+     */
+    void write(std::ostream& out) const;
+
+}; // class DirtyTiles
+
+#endif // DIRTY_TILES_HPP
@@ -0,0 +1,64 @@
+#ifndef FILE_DESCRIPTOR_HPP
+#define FILE_DESCRIPTOR_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef _MSC_VER
+# include <unistd.h>
+#else
+# include <io.h>
+#endif
+
+/**
+ * Owns a file descriptor and closes it when destroyed. Used by classes
+ * opening a file in their constructor, so that the file is closed if the
+ * constructor throws later.
+ */
+class FileDescriptor {
+
+    int m_fd;
+
+public:
+
+    explicit FileDescriptor(int fd) noexcept :
+        m_fd(fd) {
+    }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    FileDescriptor(FileDescriptor&&) = delete;
+    FileDescriptor& operator=(FileDescriptor&&) = delete;
+
+    ~FileDescriptor() noexcept {
+        if (m_fd != -1) {
+            ::close(m_fd);
+        }
+    }
+
+    int get() const noexcept {
+        return m_fd;
+    }
+
+}; // class FileDescriptor
+
+#endif // FILE_DESCRIPTOR_HPP
@@ -0,0 +1,130 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "geos_geometry.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+class GeosContext {
+
+    GEOSContextHandle_t m_handle;
+
+public:
+
+    GeosContext() :
+        m_handle(OGRGeometry::createGEOSContext()) {
+    }
+
+    GeosContext(const GeosContext&) = delete;
+    GeosContext& operator=(const GeosContext&) = delete;
+
+    GeosContext(GeosContext&&) = delete;
+    GeosContext& operator=(GeosContext&&) = delete;
+
+    ~GeosContext() noexcept {
+        OGRGeometry::freeGEOSContext(m_handle);
+    }
+
+    GEOSContextHandle_t handle() const noexcept {
+        return m_handle;
+    }
+
+}; // class GeosContext
+
+} // anonymous namespace
+
+GEOSContextHandle_t geos_context() {
+    thread_local GeosContext context;
+    return context.handle();
+}
+
+geos_geometry_ptr to_geos(const OGRGeometry* geometry) {
+    geos_geometry_ptr result{geometry->exportToGEOS(geos_context())};
+    if (!result) {
+        throw std::runtime_error{"Conversion of OGR geometry to GEOS failed"};
+    }
+    return result;
+}
+
+std::unique_ptr<OGRGeometry> to_ogr(const GEOSGeometry* geometry) {
+    // OGR doesn't change the geometry, it just wants a non-const pointer.
+    std::unique_ptr<OGRGeometry> result{OGRGeometryFactory::createFromGEOS(geos_context(), const_cast<GEOSGeometry*>(geometry))}; // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    if (!result) {
+        throw std::runtime_error{"Conversion of GEOS geometry to OGR failed"};
+    }
+    return result;
+}
+
+geos_geometry_ptr geos_rectangle(const OGREnvelope& envelope) {
+    GEOSContextHandle_t context = geos_context();
+
+    GEOSCoordSequence* seq = GEOSCoordSeq_create_r(context, 5, 2);
+    if (!seq) {
+        throw std::runtime_error{"Creating GEOS coordinate sequence failed"};
+    }
+
+    const double xs[5] = {envelope.MinX, envelope.MinX, envelope.MaxX, envelope.MaxX, envelope.MinX};
+    const double ys[5] = {envelope.MinY, envelope.MaxY, envelope.MaxY, envelope.MinY, envelope.MinY};
+    for (unsigned int n = 0; n < 5; ++n) {
+        GEOSCoordSeq_setX_r(context, seq, n, xs[n]);
+        GEOSCoordSeq_setY_r(context, seq, n, ys[n]);
+    }
+
+    // The ring takes ownership of the sequence, the polygon of the ring,
+    // even if creating them fails.
+    GEOSGeometry* ring = GEOSGeom_createLinearRing_r(context, seq);
+    if (!ring) {
+        throw std::runtime_error{"Creating GEOS linear ring failed"};
+    }
+
+    geos_geometry_ptr polygon{GEOSGeom_createPolygon_r(context, ring, nullptr, 0)};
+    if (!polygon) {
+        throw std::runtime_error{"Creating GEOS polygon failed"};
+    }
+
+    return polygon;
+}
+
+OGREnvelope geos_envelope(const GEOSGeometry* geometry) {
+    GEOSContextHandle_t context = geos_context();
+
+    OGREnvelope envelope;
+    GEOSGeom_getXMin_r(context, geometry, &envelope.MinX);
+    GEOSGeom_getYMin_r(context, geometry, &envelope.MinY);
+    GEOSGeom_getXMax_r(context, geometry, &envelope.MaxX);
+    GEOSGeom_getYMax_r(context, geometry, &envelope.MaxY);
+
+    return envelope;
+}
+
+int geos_num_outer_points(const GEOSGeometry* polygon) {
+    GEOSContextHandle_t context = geos_context();
+    return GEOSGetNumCoordinates_r(context, GEOSGetExteriorRing_r(context, polygon));
+}
+
+std::string geos_type_name(const GEOSGeometry* geometry) {
+    char* type = GEOSGeomType_r(geos_context(), geometry);
+    std::string name{type ? type : "unknown"};
+    GEOSFree_r(geos_context(), type);
+    return name;
+}
@@ -0,0 +1,90 @@
+#ifndef GEOS_GEOMETRY_HPP
+#define GEOS_GEOMETRY_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <geos_c.h>
+#include <ogr_core.h>
+#include <ogr_geometry.h>
+
+#include <memory>
+#include <string>
+
+#if GEOS_VERSION_MAJOR < 3 || (GEOS_VERSION_MAJOR == 3 && GEOS_VERSION_MINOR < 7)
+# error "OSMCoastline needs GEOS 3.7 or greater"
+#endif
+
+/**
+ * The GEOS context of the current thread. It is created on first use with
+ * the same error handlers OGR uses and freed when the thread ends. GEOS
+ * geometries must only be used with the context they were created in, so
+ * all GEOS geometries are created, used, and destroyed with this context
+ * in the same thread.
+ */
+GEOSContextHandle_t geos_context();
+
+struct geos_geometry_deleter {
+    void operator()(GEOSGeometry* geometry) const noexcept {
+        GEOSGeom_destroy_r(geos_context(), geometry);
+    }
+};
+
+/// Owning pointer to a GEOS geometry.
+using geos_geometry_ptr = std::unique_ptr<GEOSGeometry, geos_geometry_deleter>;
+
+struct geos_prepared_deleter {
+    void operator()(const GEOSPreparedGeometry* prepared) const noexcept {
+        GEOSPreparedGeom_destroy_r(geos_context(), prepared);
+    }
+};
+
+/// Owning pointer to a prepared GEOS geometry.
+using geos_prepared_ptr = std::unique_ptr<const GEOSPreparedGeometry, geos_prepared_deleter>;
+
+/**
+ * Convert OGR geometry into GEOS geometry. Throws std::runtime_error if
+ * that fails.
+ */
+geos_geometry_ptr to_geos(const OGRGeometry* geometry);
+
+/**
+ * Convert GEOS geometry into OGR geometry. The SRS is not set on the
+ * result. Throws std::runtime_error if that fails.
+ */
+std::unique_ptr<OGRGeometry> to_ogr(const GEOSGeometry* geometry);
+
+/**
+ * Create a rectangular GEOS polygon. Throws std::runtime_error if that
+ * fails.
+ */
+geos_geometry_ptr geos_rectangle(const OGREnvelope& envelope);
+
+/// Bounding box of a non-empty GEOS geometry.
+OGREnvelope geos_envelope(const GEOSGeometry* geometry);
+
+/// Number of points in the outer ring of a GEOS polygon.
+int geos_num_outer_points(const GEOSGeometry* polygon);
+
+/// Name of the type of a GEOS geometry (for debugging output).
+std::string geos_type_name(const GEOSGeometry* geometry);
+
+#endif // GEOS_GEOMETRY_HPP
@@ -0,0 +1,179 @@
+#ifndef ID_INDEX_MAP_HPP
+#define ID_INDEX_MAP_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/types.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map from (node) IDs to 32 bit indexes using open addressing with
+ * linear probing. Deleted entries are removed by moving back following
+ * entries, so there are no tombstones.
+ *
+ * The smallest possible ID is used to mark empty slots, so it can not be
+ * used as a key.
+ */
+class IdIndexMap {
+
+public:
+
+    using index_type = uint32_t;
+
+    static constexpr const index_type not_found = std::numeric_limits<index_type>::max();
+
+private:
+
+    static constexpr const osmium::object_id_type empty_key = std::numeric_limits<osmium::object_id_type>::min();
+
+    struct slot {
+        osmium::object_id_type key;
+        index_type value;
+    };
+
+    std::vector<slot> m_slots;
+    std::size_t m_size = 0;
+
+    std::size_t mask() const noexcept {
+        return m_slots.size() - 1;
+    }
+
+    std::size_t home(osmium::object_id_type key) const noexcept {
+        // Fibonacci hashing
+        return static_cast<std::size_t>((static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> 32U) & mask();
+    }
+
+    /// Returns the position of the slot with the key or of the empty slot where it should go.
+    std::size_t find_slot(osmium::object_id_type key) const noexcept {
+        std::size_t pos = home(key);
+        while (m_slots[pos].key != key && m_slots[pos].key != empty_key) {
+            pos = (pos + 1) & mask();
+        }
+        return pos;
+    }
+
+    void grow() {
+        std::vector<slot> old_slots(m_slots.empty() ? 16 : m_slots.size() * 2, slot{empty_key, not_found});
+        swap(old_slots, m_slots);
+        for (const auto& s : old_slots) {
+            if (s.key != empty_key) {
+                m_slots[find_slot(s.key)] = s;
+            }
+        }
+    }
+
+public:
+
+    IdIndexMap() = default;
+
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    bool empty() const noexcept {
+        return m_size == 0;
+    }
+
+    /// Returns the index for the key or not_found.
+    index_type get(osmium::object_id_type key) const noexcept {
+        if (m_slots.empty()) {
+            return not_found;
+        }
+        return m_slots[find_slot(key)].value;
+    }
+
+    /// Set the index for the key, replacing an existing entry.
+    void set(osmium::object_id_type key, index_type value) {
+        assert(key != empty_key);
+        assert(value != not_found);
+        if ((m_size + 1) * 2 > m_slots.size()) {
+            grow();
+        }
+        auto& s = m_slots[find_slot(key)];
+        if (s.key == empty_key) {
+            s.key = key;
+            ++m_size;
+        }
+        s.value = value;
+    }
+
+    /// Remove the entry for the key if there is one. Returns true if there was.
+    bool erase(osmium::object_id_type key) noexcept {
+        if (m_slots.empty()) {
+            return false;
+        }
+        std::size_t pos = find_slot(key);
+        if (m_slots[pos].key == empty_key) {
+            return false;
+        }
+
+        // Move back entries that would not be found any more otherwise.
+        std::size_t next = (pos + 1) & mask();
+        while (m_slots[next].key != empty_key) {
+            const std::size_t h = home(m_slots[next].key);
+            // Can the entry at next be moved to pos? Only if its home
+            // position is not cyclically in (pos, next].
+            if (((next - h) & mask()) >= ((next - pos) & mask())) {
+                m_slots[pos] = m_slots[next];
+                pos = next;
+            }
+            next = (next + 1) & mask();
+        }
+        m_slots[pos] = slot{empty_key, not_found};
+        --m_size;
+
+        return true;
+    }
+
+    /// Change all indexes using the function.
+    template <typename TFunc>
+    void update_values(TFunc&& func) {
+        for (auto& s : m_slots) {
+            if (s.key != empty_key) {
+                s.value = func(s.value);
+            }
+        }
+    }
+
+    /// Returns all entries sorted by key.
+    std::vector<std::pair<osmium::object_id_type, index_type>> sorted_entries() const {
+        std::vector<std::pair<osmium::object_id_type, index_type>> entries;
+        entries.reserve(m_size);
+        for (const auto& s : m_slots) {
+            if (s.key != empty_key) {
+                entries.emplace_back(s.key, s.value);
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    }
+
+}; // class IdIndexMap
+
+#endif // ID_INDEX_MAP_HPP
@@ -0,0 +1,211 @@
+#ifndef INTERVAL_TREE_HPP
+#define INTERVAL_TREE_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * Dynamic set of closed integer intervals [min, max] with attached values
+ * that can be queried for all intervals overlapping a given interval.
+ *
+ * This is a treap (a binary search tree ordered by the min of the
+ * intervals with random priorities to keep it balanced) where each node
+ * also stores the largest max in its subtree. Inserting and erasing is
+ * O(log n), a query is O(log n + k) for k results (expected).
+ *
+ * The nodes are kept in a vector and referenced by index. The index
+ * returned from insert() is used to erase the interval again.
+ */
+class IntervalTree {
+
+public:
+
+    using handle_type = uint32_t;
+
+private:
+
+    static constexpr const handle_type none = std::numeric_limits<handle_type>::max();
+
+    struct node {
+        int32_t min;
+        int32_t max;
+        int32_t subtree_max;
+        uint32_t priority;
+        handle_type left;
+        handle_type right;
+        std::size_t value;
+    };
+
+    std::vector<node> m_nodes;
+    std::vector<handle_type> m_free;
+    handle_type m_root = none;
+    std::size_t m_size = 0;
+    uint32_t m_random = 2463534242U;
+
+    // xorshift random number generator for the priorities
+    uint32_t next_priority() noexcept {
+        m_random ^= m_random << 13U;
+        m_random ^= m_random >> 17U;
+        m_random ^= m_random << 5U;
+        return m_random;
+    }
+
+    // Nodes are ordered by (min, handle), so all keys are unique.
+    bool key_less(handle_type n, int32_t min, handle_type handle) const noexcept {
+        return m_nodes[n].min < min || (m_nodes[n].min == min && n < handle);
+    }
+
+    void update(handle_type n) noexcept {
+        node& nd = m_nodes[n];
+        nd.subtree_max = nd.max;
+        if (nd.left != none) {
+            nd.subtree_max = std::max(nd.subtree_max, m_nodes[nd.left].subtree_max);
+        }
+        if (nd.right != none) {
+            nd.subtree_max = std::max(nd.subtree_max, m_nodes[nd.right].subtree_max);
+        }
+    }
+
+    /// Split tree t into the nodes with keys smaller than (min, handle) and the rest.
+    void split(handle_type t, int32_t min, handle_type handle, handle_type* left, handle_type* right) noexcept {
+        if (t == none) {
+            *left = none;
+            *right = none;
+            return;
+        }
+        if (key_less(t, min, handle)) {
+            split(m_nodes[t].right, min, handle, &m_nodes[t].right, right);
+            *left = t;
+        } else {
+            split(m_nodes[t].left, min, handle, left, &m_nodes[t].left);
+            *right = t;
+        }
+        update(t);
+    }
+
+    /// Merge two trees, all keys in left must be smaller than those in right.
+    handle_type merge(handle_type left, handle_type right) noexcept {
+        if (left == none) {
+            return right;
+        }
+        if (right == none) {
+            return left;
+        }
+        if (m_nodes[left].priority > m_nodes[right].priority) {
+            m_nodes[left].right = merge(m_nodes[left].right, right);
+            update(left);
+            return left;
+        }
+        m_nodes[right].left = merge(left, m_nodes[right].left);
+        update(right);
+        return right;
+    }
+
+    template <typename TFunc>
+    void query(handle_type t, int32_t min, int32_t max, TFunc&& func) const {
+        if (t == none || m_nodes[t].subtree_max < min) {
+            return;
+        }
+        const node& nd = m_nodes[t];
+        query(nd.left, min, max, func);
+        // All nodes in the right subtree start at or after this one.
+        if (nd.min > max) {
+            return;
+        }
+        if (nd.max >= min) {
+            func(nd.value);
+        }
+        query(nd.right, min, max, func);
+    }
+
+public:
+
+    IntervalTree() = default;
+
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    bool empty() const noexcept {
+        return m_size == 0;
+    }
+
+    /// Add interval [min, max] with the value. Returns handle for erase().
+    handle_type insert(int32_t min, int32_t max, std::size_t value) {
+        assert(min <= max);
+        handle_type n = 0;
+        if (m_free.empty()) {
+            assert(m_nodes.size() < none);
+            n = static_cast<handle_type>(m_nodes.size());
+            m_nodes.push_back(node{min, max, max, next_priority(), none, none, value});
+        } else {
+            n = m_free.back();
+            m_free.pop_back();
+            m_nodes[n] = node{min, max, max, next_priority(), none, none, value};
+        }
+
+        handle_type left = none;
+        handle_type right = none;
+        split(m_root, min, n, &left, &right);
+        m_root = merge(merge(left, n), right);
+        ++m_size;
+
+        return n;
+    }
+
+    /// Remove the interval with the handle returned from insert().
+    void erase(handle_type handle) {
+        assert(handle < m_nodes.size());
+        const int32_t min = m_nodes[handle].min;
+
+        handle_type left = none;
+        handle_type rest = none;
+        split(m_root, min, handle, &left, &rest);
+        handle_type middle = none;
+        handle_type right = none;
+        split(rest, min, handle + 1, &middle, &right);
+        assert(middle == handle);
+        m_root = merge(left, right);
+
+        m_free.push_back(handle);
+        --m_size;
+    }
+
+    /**
+     * Call func with the value of each interval overlapping [min, max]
+     * (including intervals only touching it).
+     */
+    template <typename TFunc>
+    void query(int32_t min, int32_t max, TFunc&& func) const {
+        query(m_root, min, max, func);
+    }
+
+}; // class IntervalTree
+
+#endif // INTERVAL_TREE_HPP
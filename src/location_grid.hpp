@@ -0,0 +1,121 @@
+#ifndef LOCATION_GRID_HPP
+#define LOCATION_GRID_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Static grid index of locations with attached values that can be
+ * queried for all locations near a given location.
+ *
+ * The grid cells are squares of at least the given radius (in degrees),
+ * so all locations closer than the radius to the query location are in
+ * the cell of the query location or one of the eight cells around it.
+ * The query returns all locations in those nine cells, the caller has to
+ * check the real distance.
+ *
+ * The entries are kept in a vector sorted by cell row and column, so the
+ * three cells next to each other in a row are found with one binary
+ * search. Call add() for all locations, then build() once before
+ * querying.
+ */
+class LocationGrid {
+
+    struct entry {
+        int64_t row;
+        int64_t col;
+        osmium::Location location;
+        std::size_t value;
+
+        bool operator<(const entry& other) const noexcept {
+            return row < other.row || (row == other.row && col < other.col);
+        }
+    };
+
+    std::vector<entry> m_entries;
+
+    // Cell size in the internal integer coordinates of osmium::Location.
+    int64_t m_cell_size;
+
+    int64_t cell(int32_t coordinate) const noexcept {
+        // Round towards negative infinity, so cells don't get wider at 0.
+        const int64_t c = coordinate;
+        return c >= 0 ? c / m_cell_size : -((-c - 1) / m_cell_size) - 1;
+    }
+
+public:
+
+    explicit LocationGrid(double radius) :
+        // The cell is one unit larger than the radius so that rounding
+        // in the distance calculation in degrees can't make a location
+        // closer than the radius end up two cells away.
+        m_cell_size(static_cast<int64_t>(radius * osmium::coordinate_precision_factor) + 1) {
+        assert(radius >= 0);
+    }
+
+    void reserve(std::size_t size) {
+        m_entries.reserve(size);
+    }
+
+    std::size_t size() const noexcept {
+        return m_entries.size();
+    }
+
+    void add(osmium::Location location, std::size_t value) {
+        m_entries.push_back(entry{cell(location.y()), cell(location.x()), location, value});
+    }
+
+    void build() {
+        std::sort(m_entries.begin(), m_entries.end());
+    }
+
+    /**
+     * Call func(location, value) for all locations in the cell of the
+     * given location and the cells around it. The order of the calls is
+     * unspecified.
+     */
+    template <typename TFunc>
+    void query(osmium::Location location, TFunc&& func) const {
+        const int64_t row = cell(location.y());
+        const int64_t col = cell(location.x());
+        for (int64_t r = row - 1; r <= row + 1; ++r) {
+            const entry first{r, col - 1, osmium::Location{}, 0};
+            const entry last{r, col + 1, osmium::Location{}, 0};
+            auto it = std::lower_bound(m_entries.begin(), m_entries.end(), first);
+            const auto end = std::upper_bound(it, m_entries.end(), last);
+            for (; it != end; ++it) {
+                func(it->location, it->value);
+            }
+        }
+    }
+
+}; // class LocationGrid
+
+#endif // LOCATION_GRID_HPP
@@ -0,0 +1,180 @@
+#ifndef LOCATION_MAP_HPP
+#define LOCATION_MAP_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * Map from node IDs to the places where the locations of those nodes have
+ * to be written to.
+ *
+ * This is a vector of (node ID, pointer to location) pairs sorted by ID.
+ * Nodes in OSM files are usually ordered by ID, so the locations can be
+ * filled in by walking along this vector in step with the input (merge
+ * join). If the input turns out not to be ordered, we fall back to a
+ * binary search for the nodes that are out of order.
+ *
+ * For a quick check whether a node is needed at all, there is also a
+ * bitmap with one bit for each range of 2^bitmap_shift IDs between the
+ * smallest and the largest ID.
+ */
+class LocationMap {
+
+    struct entry {
+        osmium::object_id_type id;
+        osmium::Location* location;
+    };
+
+    std::vector<entry> m_entries;
+
+    static constexpr const unsigned int bitmap_shift = 6;
+
+    std::vector<uint64_t> m_bitmap;
+
+    osmium::object_id_type m_min_id = 0;
+    osmium::object_id_type m_max_id = -1;
+
+    uint64_t bitmap_pos(osmium::object_id_type id) const noexcept {
+        return static_cast<uint64_t>(id - m_min_id) >> bitmap_shift;
+    }
+
+    /// Position of the first entry with an ID not smaller than m_last_id.
+    std::size_t m_pos = 0;
+
+    /// ID of the last node seen in the input.
+    osmium::object_id_type m_last_id = std::numeric_limits<osmium::object_id_type>::min();
+
+    /// Was the input ordered by ID so far?
+    bool m_sorted_input = true;
+
+    bool m_sorted = false;
+
+public:
+
+    LocationMap() = default;
+
+    void reserve(std::size_t size) {
+        m_entries.reserve(size);
+    }
+
+    /**
+     * Add a place where the location of the node with the specified ID
+     * should be written to.
+     */
+    void add(osmium::object_id_type id, osmium::Location* location) {
+        assert(!m_sorted);
+        m_entries.push_back(entry{id, location});
+    }
+
+    /**
+     * Sort the map. Must be called after all entries have been added and
+     * before set() is called.
+     */
+    void sort() {
+        std::sort(m_entries.begin(), m_entries.end(), [](const entry& a, const entry& b) {
+            return a.id < b.id;
+        });
+        m_sorted = true;
+
+        if (m_entries.empty()) {
+            return;
+        }
+
+        m_min_id = m_entries.front().id;
+        m_max_id = m_entries.back().id;
+        m_bitmap.resize((bitmap_pos(m_max_id) / 64) + 1);
+        for (const auto& e : m_entries) {
+            const auto pos = bitmap_pos(e.id);
+            m_bitmap[pos / 64] |= 1ULL << (pos % 64);
+        }
+    }
+
+    std::size_t size() const noexcept {
+        return m_entries.size();
+    }
+
+    bool empty() const noexcept {
+        return m_entries.empty();
+    }
+
+    /**
+     * Returns true if the node with the specified ID might be needed. If
+     * this returns false, it is definitely not needed. This function can
+     * be called from several threads at the same time and while set() is
+     * running, it only reads data that doesn't change after sort().
+     */
+    bool might_contain(osmium::object_id_type id) const noexcept {
+        if (id < m_min_id || id > m_max_id) {
+            return false;
+        }
+        const auto pos = bitmap_pos(id);
+        return (m_bitmap[pos / 64] & (1ULL << (pos % 64))) != 0;
+    }
+
+    /// Returns false if any node was seen out of ID order.
+    bool sorted_input() const noexcept {
+        return m_sorted_input;
+    }
+
+    /**
+     * Set the location of the node with the specified ID in all places
+     * where it is needed. Returns true if it was needed anywhere.
+     */
+    bool set(osmium::object_id_type id, osmium::Location location) {
+        assert(m_sorted);
+        std::size_t pos = 0;
+
+        if (id >= m_last_id) {
+            m_last_id = id;
+            while (m_pos < m_entries.size() && m_entries[m_pos].id < id) {
+                ++m_pos;
+            }
+            pos = m_pos;
+        } else {
+            m_sorted_input = false;
+            const auto it = std::lower_bound(m_entries.cbegin(), m_entries.cend(), id, [](const entry& e, osmium::object_id_type value) {
+                return e.id < value;
+            });
+            pos = static_cast<std::size_t>(it - m_entries.cbegin());
+        }
+
+        bool found = false;
+        for (; pos < m_entries.size() && m_entries[pos].id == id; ++pos) {
+            *m_entries[pos].location = location;
+            found = true;
+        }
+
+        return found;
+    }
+
+}; // class LocationMap
+
+#endif // LOCATION_MAP_HPP
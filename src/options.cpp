@@ -21,6 +21,7 @@
 
 #include "return_codes.hpp"
 #include "options.hpp"
+#include "temp_file.hpp"
 #include "version.hpp"
 
 #include <cstdlib>
@@ -39,8 +40,10 @@ namespace {
 
 void print_help() {
     std::cout << "Usage: osmcoastline [OPTIONS] OSMFILE\n"
+              << "       osmcoastline [OPTIONS] --read-snapshot=FILE\n"
               << "\nOptions:\n"
               << "  -h, --help                 - This help message\n"
+              << "  -C, --apply-changes=FILE   - Apply OSM change file to rings from snapshot\n"
               << "  -c, --close-distance=DIST  - Distance between nodes under which open rings\n"
               << "                               are closed (0 - disable closing of rings)\n"
               << "  -b, --bbox-overlap=OVERLAP - Set overlap when splitting polygons\n"
@@ -48,18 +51,31 @@ void print_help() {
               << "  -d, --debug                - Enable debugging output\n"
               << "  -e, --exit-ignore-warnings - Exit with code 0 even if there are warnings\n"
               << "  -f, --overwrite            - Overwrite output file if it already exists\n"
+              << "  -F, --input-format=FORMAT  - Format of input file (needed when reading\n"
+              << "                               from STDIN, for example 'pbf')\n"
               << "  -g, --gdal-driver=DRIVER   - GDAL driver (SQLite or ESRI Shapefile)\n"
               << "  -l, --output-lines         - Output coastlines as lines to database file\n"
+              << "  -L, --location-cache=FILE  - File for node locations in single pass mode\n"
+              << "                               (default: output database name + '.locations')\n"
               << "  -m, --max-points=NUM       - Split lines/polygons with more than this many\n"
               << "                               points (0 - disable splitting)\n"
+              << "  -M, --segment-memory=MB    - Memory for segments when checking for\n"
+              << "                               intersections, more are sorted on disk\n"
+              << "                               (0 - no limit, default)\n"
               << "  -o, --output-database=FILE - Database file for output\n"
               << "  -p, --output-polygons=land|water|both|none\n"
               << "                             - Which polygons to write out (default: land)\n"
+              << "  -P, --single-pass          - Read nodes and ways in a single pass (needed\n"
+              << "                               when reading from STDIN)\n"
               << "  -r, --output-rings         - Output rings to database file\n"
+              << "  -R, --read-snapshot=FILE   - Read rings from snapshot file instead of OSMFILE\n"
               << "  -s, --srs=EPSGCODE         - Set SRS (4326 for WGS84 (default) or 3857)\n"
               << "  -S, --write-segments=FILE  - Write segments to given file\n"
+              << "  -T, --temp-dir=DIR         - Directory for temporary files (default:\n"
+              << "                               TMPDIR or directory of output database)\n"
               << "  -v, --verbose              - Verbose output\n"
               << "  -V, --version              - Show version and exit\n"
+              << "  -W, --write-snapshot=FILE  - Write assembled rings to snapshot file\n"
               << "\n";
 }
 
@@ -96,37 +112,57 @@ int get_epsg(const char* text) {
     std::exit(return_code_cmdline);
 }
 
+// Values returned by getopt_long() for the hidden options which have no
+// short form.
+const int opt_min_slab_segments = 256;
+const int opt_max_memory_segments = 257;
+const int opt_no_avx2 = 258;
+
 } // anonymous namespace
 
 int Options::parse(int argc, char* argv[]) {
     static struct option long_options[] = {
+        {"apply-changes",   required_argument, nullptr, 'C'},
         {"bbox-overlap",    required_argument, nullptr, 'b'},
         {"close-distance",  required_argument, nullptr, 'c'},
         {"no-index",              no_argument, nullptr, 'i'},
+        {"no-avx2",               no_argument, nullptr, opt_no_avx2},
         {"debug",                 no_argument, nullptr, 'd'},
         {"exit-ignore-warnings",  no_argument, nullptr, 'e'},
+        {"input-format",    required_argument, nullptr, 'F'},
         {"gdal-driver",     required_argument, nullptr, 'g'},
         {"help",                  no_argument, nullptr, 'h'},
         {"output-lines",          no_argument, nullptr, 'l'},
+        {"location-cache",  required_argument, nullptr, 'L'},
         {"max-points",      required_argument, nullptr, 'm'},
+        {"min-slab-segments", required_argument, nullptr, opt_min_slab_segments},
+        {"max-memory-segments", required_argument, nullptr, opt_max_memory_segments},
+        {"segment-memory",  required_argument, nullptr, 'M'},
         {"output-database", required_argument, nullptr, 'o'},
         {"output-polygons", required_argument, nullptr, 'p'},
+        {"single-pass",           no_argument, nullptr, 'P'},
         {"output-rings",          no_argument, nullptr, 'r'},
+        {"read-snapshot",   required_argument, nullptr, 'R'},
         {"overwrite",             no_argument, nullptr, 'f'},
         {"srs",             required_argument, nullptr, 's'},
         {"write-segments",  required_argument, nullptr, 'S'},
+        {"temp-dir",        required_argument, nullptr, 'T'},
         {"verbose",               no_argument, nullptr, 'v'},
         {"version",               no_argument, nullptr, 'V'},
+        {"write-snapshot",  required_argument, nullptr, 'W'},
         {nullptr,                           0, nullptr, 0}
     };
 
     while (true) {
-        const int c = getopt_long(argc, argv, "b:c:ideg:hlm:o:p:rfs:S:vV", long_options, nullptr);
+        const int c = getopt_long(argc, argv, "C:b:c:ideF:g:hlL:m:M:o:p:PrR:fs:S:T:vVW:", long_options, nullptr);
         if (c == -1) {
             break;
         }
 
         switch (c) {
+            case 'C':
+                change_file = optarg;
+                break;
             case 'b':
                 bbox_overlap = std::atof(optarg); // NOLINT(cert-err34-c) atof is good enough for this use case
                 break;
@@ -146,18 +182,40 @@ int Options::parse(int argc, char* argv[]) {
             case 'h':
                 print_help();
                 return return_code_ok;
+            case 'F':
+                input_format = optarg;
+                break;
             case 'g':
                 driver = optarg;
                 break;
             case 'l':
                 output_lines = true;
                 break;
+            case 'L':
+                location_cache = optarg;
+                break;
             case 'm':
                 max_points_in_polygon = std::atoi(optarg); // NOLINT(cert-err34-c) atoi is good enough for this use case
                 if (max_points_in_polygon == 0) {
                     split_large_polygons = false;
                 }
                 break;
+            case 'M':
+                segment_memory = std::strtoul(optarg, nullptr, 10);
+                break;
+            case opt_max_memory_segments:
+                max_segments_in_memory = std::strtoul(optarg, nullptr, 10);
+                break;
+            case opt_no_avx2:
+                use_avx2 = false;
+                break;
+            case opt_min_slab_segments:
+                min_segments_per_slab = std::strtoul(optarg, nullptr, 10);
+                if (min_segments_per_slab == 0) {
+                    std::cerr << "The --min-slab-segments option must be larger than 0\n";
+                    return return_code_cmdline;
+                }
+                break;
             case 'p':
                 if (!std::strcmp(optarg, "none")) {
                     output_polygons = output_polygon_type::none;
@@ -175,9 +233,15 @@ int Options::parse(int argc, char* argv[]) {
             case 'o':
                 output_database = optarg;
                 break;
+            case 'P':
+                single_pass = true;
+                break;
             case 'r':
                 output_rings = true;
                 break;
+            case 'R':
+                read_snapshot = optarg;
+                break;
             case 'f':
                 overwrite_output = true;
                 break;
@@ -187,12 +251,18 @@ int Options::parse(int argc, char* argv[]) {
             case 'S':
                 segmentfile = optarg;
                 break;
+            case 'T':
+                temp_dir = optarg;
+                break;
             case 'v':
                 verbose = true;
                 break;
             case 'V':
                 print_version();
                 return return_code_ok;
+            case 'W':
+                write_snapshot = optarg;
+                break;
             default:
                 return return_code_cmdline;
         }
@@ -203,7 +273,21 @@ int Options::parse(int argc, char* argv[]) {
         return return_code_cmdline;
     }
 
-    if (optind != argc - 1) {
+    if (!change_file.empty() && read_snapshot.empty()) {
+        std::cerr << "Can only use --apply-changes/-C option together with --read-snapshot/-R option.\n";
+        return return_code_cmdline;
+    }
+
+    if (!read_snapshot.empty()) {
+        if (optind != argc) {
+            std::cerr << "Can not use OSMFILE together with --read-snapshot/-R option.\n";
+            return return_code_cmdline;
+        }
+        if (single_pass || !input_format.empty()) {
+            std::cerr << "Can not use --single-pass/-P or --input-format/-F options together with --read-snapshot/-R option.\n";
+            return return_code_cmdline;
+        }
+    } else if (optind != argc - 1) {
         std::cerr << "Usage: osmcoastline [OPTIONS] OSMFILE\n";
         return return_code_cmdline;
     }
@@ -213,6 +297,10 @@ int Options::parse(int argc, char* argv[]) {
         return return_code_cmdline;
     }
 
+    if (temp_dir.empty()) {
+        temp_dir = default_temp_dir(output_database);
+    }
+
     if (bbox_overlap == -1) {
         if (epsg == 4326) {
             bbox_overlap = 0.0001;
@@ -221,8 +309,27 @@ int Options::parse(int argc, char* argv[]) {
         }
     }
 
+    if (!read_snapshot.empty()) {
+        return -1;
+    }
+
     inputfile = argv[optind];
 
+    if (inputfile == "-") {
+        if (input_format.empty()) {
+            std::cerr << "Need --input-format/-F option when reading from STDIN.\n";
+            return return_code_cmdline;
+        }
+        if (!single_pass) {
+            std::cerr << "Need --single-pass/-P option when reading from STDIN.\n";
+            return return_code_cmdline;
+        }
+    }
+
+    if (single_pass && location_cache.empty()) {
+        location_cache = output_database + ".locations";
+    }
+
     return -1;
 }
 
@@ -22,6 +22,7 @@
 
 */
 
+#include <cstddef>
 #include <string>
 
 enum class output_polygon_type {
@@ -39,6 +40,24 @@ struct Options {
     /// Input OSM file name.
     std::string inputfile;
 
+    /// Format of the input file (empty: autodetect from file name).
+    std::string input_format;
+
+    /// Read nodes and ways in a single pass through the input file?
+    bool single_pass = false;
+
+    /// File for node locations in single pass mode.
+    std::string location_cache;
+
+    /// Snapshot file to read the rings from instead of the input file.
+    std::string read_snapshot;
+
+    /// Snapshot file to write the rings to.
+    std::string write_snapshot;
+
+    /// OSM change file to apply to the rings read from the snapshot.
+    std::string change_file;
+
     /// Overlap when splitting polygons.
     double bbox_overlap = -1.0;
 
@@ -96,6 +115,39 @@ struct Options {
     /// Name of optional segment file
     std::string segmentfile;
 
+    /**
+     * Memory (in MBytes) for the segments in the intersection check. If
+     * there are more segments, they are sorted in runs written to
+     * temporary files. 0 means no limit.
+     */
+    std::size_t segment_memory = 0;
+
+    /**
+     * Maximum number of segments kept in memory in the intersection check.
+     * Only set by a hidden option for testing the sorting on disk with
+     * small inputs. Overrides segment_memory if not 0.
+     */
+    std::size_t max_segments_in_memory = 0;
+
+    /**
+     * Directory for temporary files. Default is the TMPDIR environment
+     * variable or the directory of the output database.
+     */
+    std::string temp_dir;
+
+    /**
+     * Minimum number of segments in a slab for the parallel intersection
+     * check. Only set by a hidden option for testing the check with several
+     * slabs on small inputs.
+     */
+    std::size_t min_segments_per_slab = 100000;
+
+    /**
+     * Use AVX2 instructions in the intersection check if the CPU has them?
+     * Only unset by a hidden option for comparing the results in tests.
+     */
+    bool use_avx2 = true;
+
     int parse(int argc, char* argv[]);
 
 }; // struct Options
@@ -21,33 +21,58 @@
 
 #include "coastline_polygons.hpp"
 #include "coastline_ring_collection.hpp"
+#include "location_map.hpp"
 #include "options.hpp"
 #include "output_database.hpp"
+#include "pbf_block_reader.hpp"
+#include "polygon_nesting.hpp"
+#include "segment_file.hpp"
+#include "segment_intersection.hpp"
 #include "return_codes.hpp"
 #include "srs.hpp"
 #include "stats.hpp"
 #include "util.hpp"
 #include "version.hpp"
 
+#include <osmium/geom/ogr.hpp>
+#include <osmium/handler/node_locations_for_ways.hpp>
+#include <osmium/index/map/dense_file_array.hpp>
+#include <osmium/index/map/sparse_mem_array.hpp>
 #include <osmium/io/any_input.hpp>
 #include <osmium/io/file.hpp>
+#include <osmium/io/header.hpp>
+#include <osmium/memory/buffer.hpp>
 #include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/types.hpp>
+#include <osmium/osm/undirected_segment.hpp>
+#include <osmium/osm/way.hpp>
+#include <osmium/thread/pool.hpp>
 #include <osmium/util/memory.hpp>
 #include <osmium/util/verbose_output.hpp>
 
+#include <protozero/data_view.hpp>
+
 #include <ogr_core.h>
 #include <ogr_geometry.h>
 
-#include <cassert>
 #include <cerrno>
+#include <cstddef>
 #include <cstdlib>
-#include <cstring>
+#include <deque>
 #include <exception>
+#include <fcntl.h>
+#include <future>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -66,28 +91,252 @@ bool debug;
 
 namespace {
 
+// Node location storage for the single pass mode
+using index_pos_type = osmium::index::map::DenseFileArray<osmium::unsigned_object_id_type, osmium::Location>;
+using index_neg_type = osmium::index::map::SparseMemArray<osmium::unsigned_object_id_type, osmium::Location>;
+using location_handler_type = osmium::handler::NodeLocationsForWays<index_pos_type, index_neg_type>;
+
+// Initial size of buffers with filtered coastline ways
+const std::size_t filtered_buffer_size = 64UL * 1024UL;
+
+// How many buffers can be filtered in the thread pool at the same time
+const std::size_t max_filter_queue_size = 20;
+
 // If there are more than this many warnings, the program exit code will indicate an error.
 const unsigned int max_warnings = 500;
 
 /* ================================================== */
 
-void add_polygons_in_multi_to(polygon_vector_type *polygons,
-                              std::unique_ptr<OGRGeometry> mega_geometry,
-                              OutputDatabase& output,
-                              unsigned int* warnings, unsigned int* errors) {
-    // This isn't an owning pointer on purpose. We are going to "steal" parts
-    // of the geometry a few lines below but only mark them as unowned farther
-    // below when we are calling removeGeometry() on it. If this was an
-    // owning pointer we'd get a double free if there is an error.
-    auto* mega_multipolygon = static_cast<OGRMultiPolygon*>(mega_geometry.release());
-
-    polygons->reserve(mega_multipolygon->getNumGeometries());
-    for (int i = 0; i < mega_multipolygon->getNumGeometries(); ++i) {
-        OGRGeometry* geom = mega_multipolygon->getGeometryRef(i);
-        assert(geom);
-        assert(geom->getGeometryType() == wkbPolygon);
-        std::unique_ptr<OGRPolygon> p{static_cast<OGRPolygon*>(geom)};
-        if (p->IsValid()) {
+/**
+ * We are only interested in ways tagged with natural=coastline, but ignore
+ * bogus coastline in Antarctica.
+ */
+bool is_coastline_way(const osmium::Way& way) {
+    return way.tags().has_tag("natural", "coastline") &&
+           !way.tags().has_tag("coastline", "bogus");
+}
+
+/**
+ * Copy all coastline ways from the buffer into a new buffer. This is
+ * called in the thread pool for several buffers at the same time.
+ */
+osmium::memory::Buffer filter_coastline_ways(const osmium::memory::Buffer& buffer) {
+    osmium::memory::Buffer out{filtered_buffer_size, osmium::memory::Buffer::auto_grow::yes};
+    for (const auto& way : buffer.select<osmium::Way>()) {
+        if (is_coastline_way(way)) {
+            out.add_item(way);
+            out.commit();
+        }
+    }
+    return out;
+}
+
+/**
+ * History files can contain several versions of the same way, which would
+ * all be assembled into rings. They are not supported.
+ */
+void check_not_history_file(const osmium::io::Header& header, const osmium::io::File& infile) {
+    if (header.has_multiple_object_versions()) {
+        throw std::runtime_error{"Input file '" + infile.filename() + "' is a history file. This is not supported"};
+    }
+}
+
+/**
+ * Add all ways in the buffer to the collection. The buffer must only
+ * contain coastline ways.
+ */
+void add_ways(CoastlineRingCollection& coastline_rings, const osmium::memory::Buffer& buffer) {
+    for (const auto& way : buffer.select<osmium::Way>()) {
+        coastline_rings.add_way(way);
+    }
+}
+
+/**
+ * Read all coastline ways from the input file.
+ *
+ * The ways are filtered in the thread pool, only assembling the rings
+ * happens in this thread. The filtered buffers are handled in the order
+ * of the input file so that the resulting rings are always the same.
+ */
+void read_ways(const osmium::io::File& infile, CoastlineRingCollection& coastline_rings, osmium::util::VerboseOutput& vout) {
+    if (PBFBlockReader::can_read(infile)) {
+        // Blocks without the string "coastline" in their string table
+        // can not contain any coastline ways, so they are not decoded.
+        PBFBlockReader reader{infile.filename(), osmium::osm_entity_bits::way, [](protozero::data_view block) {
+            return string_table_contains(block, "coastline");
+        }, filter_coastline_ways};
+        check_not_history_file(reader.header(), infile);
+        while (const auto buffer = reader.read()) {
+            add_ways(coastline_rings, buffer);
+        }
+        vout << "  Skipped " << reader.num_skipped_blocks() << " of " << reader.num_blocks() << " blocks without coastline tags.\n";
+        return;
+    }
+
+    auto& pool = osmium::thread::Pool::default_instance();
+    std::deque<std::future<osmium::memory::Buffer>> queue;
+
+    osmium::io::Reader reader{infile, osmium::osm_entity_bits::way, osmium::io::read_meta::no};
+    check_not_history_file(reader.header(), infile);
+    bool eof = false;
+    while (true) {
+        while (!eof && queue.size() < max_filter_queue_size) {
+            auto buffer = reader.read();
+            if (!buffer) {
+                eof = true;
+                break;
+            }
+            queue.push_back(pool.submit([buffer = std::move(buffer)]() {
+                return filter_coastline_ways(buffer);
+            }));
+        }
+        if (queue.empty()) {
+            break;
+        }
+        add_ways(coastline_rings, queue.front().get());
+        queue.pop_front();
+    }
+    reader.close();
+}
+
+/**
+ * Nodes tagged natural=coastline are reported as errors.
+ */
+void check_tagged_node(const osmium::Node& node, OutputDatabase& output, osmium::geom::OGRFactory<>& factory) {
+    if (node.tags().has_tag("natural", "coastline")) {
+        try {
+            output.add_error_point(factory.create_point(node), "tagged_node", node.id());
+        } catch (const osmium::geometry_error&) {
+            std::cerr << "Ignoring illegal geometry for node " << node.id() << ".\n";
+        }
+    }
+}
+
+/**
+ * Set the locations of all nodes in the buffer we need for the coastline
+ * rings. Nodes tagged natural=coastline are reported as errors.
+ */
+void set_node_locations(LocationMap& locmap, OutputDatabase& output, osmium::geom::OGRFactory<>& factory, const osmium::memory::Buffer& buffer) {
+    for (const auto& node : buffer.select<osmium::Node>()) {
+        check_tagged_node(node, output, factory);
+        locmap.set(node.id(), node.location());
+    }
+}
+
+/**
+ * Read all nodes from the input file and set the locations of the nodes
+ * needed for the coastline rings.
+ */
+void read_node_locations(const osmium::io::File& infile, CoastlineRingCollection& coastline_rings, OutputDatabase& output, osmium::util::VerboseOutput& vout) {
+    LocationMap locmap;
+    coastline_rings.setup_locations(locmap);
+    osmium::geom::OGRFactory<> factory;
+    if (PBFBlockReader::can_read(infile)) {
+        // Only blocks with nodes we need or with nodes tagged
+        // natural=coastline are decoded completely.
+        PBFBlockReader reader{infile.filename(), osmium::osm_entity_bits::node, [&locmap](protozero::data_view block) {
+            return string_table_contains(block, "coastline") ||
+                   any_node_id(block, [&locmap](osmium::object_id_type id) {
+                       return locmap.might_contain(id);
+                   });
+        }};
+        while (const auto buffer = reader.read()) {
+            set_node_locations(locmap, output, factory, buffer);
+        }
+        vout << "  Skipped " << reader.num_skipped_blocks() << " of " << reader.num_blocks() << " blocks without needed nodes.\n";
+    } else {
+        osmium::io::Reader reader{infile, osmium::osm_entity_bits::node, osmium::io::read_meta::no};
+        while (const auto buffer = reader.read()) {
+            set_node_locations(locmap, output, factory, buffer);
+        }
+        reader.close();
+    }
+    if (!locmap.sorted_input()) {
+        vout << "  Input file is not ordered by node ID. This is slower than necessary.\n";
+    }
+}
+
+/**
+ * Read nodes and ways in a single pass through the input file. Node
+ * locations are stored in a dense array in a memory mapped (sparse) file,
+ * so that the ways can get their locations right away. This doesn't need
+ * a seekable input file, so it works with input from STDIN or a pipe.
+ */
+void read_nodes_and_ways(const osmium::io::File& infile, const std::string& cache_filename, CoastlineRingCollection& coastline_rings, OutputDatabase& output) {
+    const int fd = ::open(cache_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666); // NOLINT(hicpp-signed-bitwise)
+    if (fd == -1) {
+        throw std::system_error{errno, std::system_category(), std::string{"Can not open location cache file '"} + cache_filename + "'"};
+    }
+
+    try {
+        index_pos_type index_pos{fd};
+        index_neg_type index_neg;
+        location_handler_type location_handler{index_pos, index_neg};
+
+        // The index for negative IDs is a sorted vector, it has to be
+        // sorted after adding nodes before it can be searched. (We don't
+        // use location_handler.way() which would do that, because it
+        // overwrites the locations already on the way.)
+        bool must_sort_neg = false;
+
+        osmium::geom::OGRFactory<> factory;
+        osmium::io::Reader reader{infile, osmium::osm_entity_bits::node | osmium::osm_entity_bits::way, osmium::io::read_meta::no};
+        check_not_history_file(reader.header(), infile);
+        while (auto buffer = reader.read()) {
+            for (const auto& node : buffer.select<osmium::Node>()) {
+                location_handler.node(node);
+                if (node.id() < 0) {
+                    must_sort_neg = true;
+                }
+                check_tagged_node(node, output, factory);
+            }
+            for (auto& way : buffer.select<osmium::Way>()) {
+                if (is_coastline_way(way)) {
+                    if (must_sort_neg) {
+                        index_neg.sort();
+                        must_sort_neg = false;
+                    }
+                    // Locations already on the way are kept, missing
+                    // locations are reported later.
+                    for (auto& node_ref : way.nodes()) {
+                        if (!node_ref.location()) {
+                            node_ref.set_location(location_handler.get_node_location(node_ref.ref()));
+                        }
+                    }
+                    coastline_rings.add_way(way);
+                }
+            }
+        }
+        reader.close();
+    } catch (...) {
+        ::close(fd);
+        ::unlink(cache_filename.c_str());
+        throw;
+    }
+
+    ::close(fd);
+    ::unlink(cache_filename.c_str());
+}
+
+/* ================================================== */
+
+/**
+ * Add all valid polygons to the output vector. Invalid polygons are
+ * repaired with Buffer(0) if possible. Polygons already known to be
+ * valid are not checked again.
+ */
+void add_valid_polygons_to(polygon_vector_type *polygons,
+                           polygon_vector_type&& nested_polygons,
+                           OutputDatabase& output,
+                           unsigned int* warnings, unsigned int* errors,
+                           unsigned int* skipped_checks) {
+    polygons->reserve(nested_polygons.size());
+    for (auto& p : nested_polygons) {
+        if (p.known_valid()) {
+            (*skipped_checks)++;
+            polygons->push_back(std::move(p));
+        } else if (p->IsValid()) {
+            p.valid = validity::assembly;
             polygons->push_back(std::move(p));
         } else {
             auto* ring = p->getExteriorRing()->clone();
@@ -96,7 +345,7 @@ void add_polygons_in_multi_to(polygon_vector_type *polygons,
             std::unique_ptr<OGRGeometry> buf0{p->Buffer(0)};
             if (buf0 && buf0->getGeometryType() == wkbPolygon && buf0->IsValid()) {
                 buf0->assignSpatialReference(srs.wgs84());
-                polygons->push_back(static_cast_unique_ptr<OGRPolygon>(std::move(buf0)));
+                polygons->emplace_back(static_cast_unique_ptr<OGRPolygon>(std::move(buf0)), validity::assembly);
                 (*warnings)++;
             } else {
                 std::cerr << "Ignoring invalid polygon geometry.\n";
@@ -104,48 +353,44 @@ void add_polygons_in_multi_to(polygon_vector_type *polygons,
             }
         }
     }
-
-    mega_multipolygon->removeGeometry(-1, FALSE);
-    delete mega_multipolygon; // NOLINT(cppcoreguidelines-owning-memory)
 }
 
 /**
- * This function assembles all the coastline rings into one huge multipolygon.
+ * This function assembles all the coastline rings into polygons with holes.
+ * The number of validity checks skipped because the polygons were already
+ * known to be valid is added to skipped_checks.
  */
-polygon_vector_type create_polygons(CoastlineRingCollection& coastline_rings, OutputDatabase& output, unsigned int* warnings, unsigned int* errors) {
-    std::vector<OGRGeometry*> all_polygons = coastline_rings.add_polygons_to_vector();
+polygon_vector_type create_polygons(CoastlineRingCollection& coastline_rings, OutputDatabase& output, unsigned int* warnings, unsigned int* errors, unsigned int* skipped_checks) {
+    polygon_vector_type all_polygons = coastline_rings.add_polygons_to_vector(skipped_checks);
 
     if (all_polygons.empty()) {
         throw std::runtime_error{"No polygons created!"};
     }
 
-    int is_valid = false;
-    const char* options[] = {"METHOD=ONLY_CCW", nullptr};
     if (debug) {
-        std::cerr << "Calling organizePolygons()\n";
+        std::cerr << "Nesting " << all_polygons.size() << " polygons\n";
     }
-    std::unique_ptr<OGRGeometry> mega_geometry{OGRGeometryFactory::organizePolygons(all_polygons.data(), static_cast<int>(all_polygons.size()), &is_valid, options)};
+    polygon_vector_type nested_polygons = nest_polygons(std::move(all_polygons));
     if (debug) {
-        std::cerr << "organizePolygons() done (" << (is_valid ? "valid" : "invalid") << ")\n";
-    }
-
-    if (!mega_geometry) {
-        throw std::runtime_error{"No polygons created!"};
+        std::cerr << "Nesting done (" << nested_polygons.size() << " polygons)\n";
     }
 
     polygon_vector_type polygons;
 
-    if (mega_geometry->getGeometryType() == wkbPolygon) {
-        if (mega_geometry->IsValid()) {
-            polygons.push_back(static_cast_unique_ptr<OGRPolygon>(std::move(mega_geometry)));
+    if (nested_polygons.size() == 1) {
+        auto& p = nested_polygons.front();
+        if (p.known_valid()) {
+            (*skipped_checks)++;
+            polygons.push_back(std::move(p));
+        } else if (p->IsValid()) {
+            p.valid = validity::assembly;
+            polygons.push_back(std::move(p));
         } else {
             std::cerr << "Ignoring invalid polygon geometry.\n";
             (*errors)++;
         }
-    } else if (mega_geometry->getGeometryType() != wkbMultiPolygon) {
-        throw std::runtime_error{"mega geometry isn't a (multi)polygon. Something is very wrong!"};
     } else {
-        add_polygons_in_multi_to(&polygons, std::move(mega_geometry), output, warnings, errors);
+        add_valid_polygons_to(&polygons, std::move(nested_polygons), output, warnings, errors, skipped_checks);
     }
 
     return polygons;
@@ -170,6 +415,106 @@ std::unique_ptr<OutputDatabase> open_output_database(const std::string& driver,
     return nullptr;
 }
 
+/**
+ * Apply an OSM change file to the rings read from a snapshot. All ways in
+ * the change file are removed from the rings, current versions of coastline
+ * ways are then added again. Locations of changed nodes are updated. Nodes
+ * of new ways not in the change file get their locations from the removed
+ * ways or from the rings.
+ */
+void apply_changes(const std::string& filename, CoastlineRingCollection& coastline_rings, OutputDatabase& output, osmium::util::VerboseOutput& vout) {
+    std::vector<osmium::memory::Buffer> buffers;
+    std::unordered_map<osmium::object_id_type, const osmium::Node*> nodes;
+    std::map<osmium::object_id_type, osmium::Way*> ways;
+
+    // Change files can contain several versions of the same object, we
+    // only need the newest one.
+    osmium::io::Reader reader{filename, osmium::osm_entity_bits::node | osmium::osm_entity_bits::way};
+    while (auto buffer = reader.read()) {
+        for (const auto& node : buffer.select<osmium::Node>()) {
+            auto& n = nodes[node.id()];
+            if (!n || n->version() <= node.version()) {
+                n = &node;
+            }
+        }
+        for (auto& way : buffer.select<osmium::Way>()) {
+            auto& w = ways[way.id()];
+            if (!w || w->version() <= way.version()) {
+                w = &way;
+            }
+        }
+        buffers.push_back(std::move(buffer));
+    }
+    reader.close();
+
+    vout << "  Change file contains " << nodes.size() << " nodes and " << ways.size() << " ways.\n";
+
+    osmium::geom::OGRFactory<> factory;
+    std::unordered_map<osmium::object_id_type, osmium::Location> locations;
+    for (const auto& n : nodes) {
+        const osmium::Node& node = *n.second;
+        if (node.visible()) {
+            locations[node.id()] = node.location();
+            check_tagged_node(node, output, factory);
+        } else {
+            locations[node.id()] = osmium::Location{};
+        }
+    }
+    coastline_rings.update_locations(locations);
+
+    std::unordered_set<osmium::object_id_type> way_ids;
+    for (const auto& w : ways) {
+        way_ids.insert(w.first);
+    }
+    // After this the locations map also contains the locations of all
+    // nodes of the removed ways. Changed nodes keep their new locations.
+    const auto affected_rings = coastline_rings.remove_ways(way_ids, &locations);
+    vout << "  Split " << affected_rings << " rings containing changed ways.\n";
+
+    std::size_t added_ways = 0;
+    for (const auto& w : ways) {
+        osmium::Way& way = *w.second;
+        if (way.visible() && is_coastline_way(way) && !way.nodes().empty()) {
+            for (auto& node_ref : way.nodes()) {
+                const auto it = locations.find(node_ref.ref());
+                if (it != locations.end()) {
+                    node_ref.set_location(it->second);
+                }
+            }
+            coastline_rings.add_way(way);
+            ++added_ways;
+        }
+    }
+    vout << "  Added " << added_ways << " new or changed coastline ways.\n";
+    coastline_rings.finish_assembly();
+
+    LocationMap locmap;
+    coastline_rings.setup_locations(locmap);
+    coastline_rings.set_locations_from_rings(locmap);
+}
+
+/**
+ * Update statistics and show some information about the rings after
+ * reading them.
+ */
+void report_rings(const CoastlineRingCollection& coastline_rings, Stats& stats, osmium::util::VerboseOutput& vout) {
+    stats.ways = coastline_rings.num_ways();
+    stats.unconnected_nodes = coastline_rings.num_unconnected_nodes();
+    stats.rings = coastline_rings.size();
+    stats.rings_from_single_way = coastline_rings.num_rings_from_single_way();
+    vout << "  There are "
+         << coastline_rings.num_unconnected_nodes()
+         << " nodes where the coastline is not closed.\n";
+    vout << "  There are "
+         << coastline_rings.size()
+         << " coastline rings ("
+         << coastline_rings.num_rings_from_single_way()
+         << " from a single closed way and "
+         << (coastline_rings.size() - coastline_rings.num_rings_from_single_way())
+         << " others).\n";
+    vout << memory_usage();
+}
+
 } // anonymous namespace
 
 /* ================================================== */
@@ -204,12 +549,13 @@ int main(int argc, char *argv[]) {
     }
 
     // Optionally set up segments file
-    int segments_fd = -1;
+    std::unique_ptr<SegmentFileWriter> segment_writer;
     if (!options.segmentfile.empty()) {
         vout << "Writing segments to file '" << options.segmentfile << "' (because you told me to with --write-segments/-S option).\n";
-        segments_fd = ::open(options.segmentfile.c_str(), O_WRONLY | O_CREAT, 0666); // NOLINT(hicpp-signed-bitwise)
-        if (segments_fd == -1) {
-            std::cerr << "Couldn't open file '" << options.segmentfile << "' (" << std::strerror(errno) << ")\n";
+        try {
+            segment_writer = std::make_unique<SegmentFileWriter>(options.segmentfile);
+        } catch (const std::system_error& e) {
+            std::cerr << "Couldn't open file '" << options.segmentfile << "' (" << e.code().message() << ")\n";
             return return_code_fatal;
         }
     }
@@ -237,64 +583,44 @@ int main(int argc, char *argv[]) {
     CoastlineRingCollection coastline_rings;
 
     try {
-        // This is in an extra scope so that the considerable amounts of memory
-        // held by some intermediate datastructures is recovered after we don't
-        // need them any more.
-        vout << "Reading from file '" << options.inputfile << "'.\n";
-        const osmium::io::File infile{options.inputfile};
-
-        vout << "Reading ways (1st pass through input file)...\n";
-        osmium::io::Reader reader1{infile, osmium::osm_entity_bits::way};
-        while (const auto buffer = reader1.read()) {
-            for (const auto& way : buffer.select<osmium::Way>()) {
-                // We are only interested in ways tagged with natural=coastline.
-                if (way.tags().has_tag("natural", "coastline")) {
-                    // ignore bogus coastline in Antarctica
-                    if (!way.tags().has_tag("coastline", "bogus")) {
-                        coastline_rings.add_way(way);
-                    }
-                }
+        if (!options.read_snapshot.empty()) {
+            vout << "Reading snapshot from file '" << options.read_snapshot << "' (because you used the --read-snapshot/-R option)...\n";
+            coastline_rings.read_snapshot(options.read_snapshot);
+            if (!options.change_file.empty()) {
+                vout << "Applying changes from file '" << options.change_file << "' (because you used the --apply-changes/-C option)...\n";
+                apply_changes(options.change_file, coastline_rings, *output_database, vout);
             }
-        }
-        reader1.close();
-        stats.ways = coastline_rings.num_ways();
-        stats.unconnected_nodes = coastline_rings.num_unconnected_nodes();
-        stats.rings = coastline_rings.size();
-        stats.rings_from_single_way = coastline_rings.num_rings_from_single_way();
-        vout << "  There are "
-             << coastline_rings.num_unconnected_nodes()
-             << " nodes where the coastline is not closed.\n";
-        vout << "  There are "
-             << coastline_rings.size()
-             << " coastline rings ("
-             << coastline_rings.num_rings_from_single_way()
-             << " from a single closed way and "
-             << (coastline_rings.size() - coastline_rings.num_rings_from_single_way())
-             << " others).\n";
-        vout << memory_usage();
-
-        vout << "Reading nodes (2nd pass through input file)...\n";
-        locmap_type locmap{};
-        coastline_rings.setup_locations(locmap);
-        osmium::geom::OGRFactory<> factory;
-        osmium::io::Reader reader2{infile, osmium::osm_entity_bits::node};
-        while (const auto buffer = reader2.read()) {
-            for (const auto& node : buffer.select<osmium::Node>()) {
-                if (node.tags().has_tag("natural", "coastline")) {
-                    try {
-                        output_database->add_error_point(factory.create_point(node), "tagged_node", node.id());
-                    } catch (const osmium::geometry_error&) {
-                        std::cerr << "Ignoring illegal geometry for node " << node.id() << ".\n";
-                    }
-                }
-
-                const auto ret = locmap.equal_range(node.id());
-                for (auto it = ret.first; it != ret.second; ++it) {
-                    *(it->second) = node.location();
+            report_rings(coastline_rings, stats, vout);
+        } else {
+            // This is in an extra scope so that the considerable amounts of memory
+            // held by some intermediate datastructures is recovered after we don't
+            // need them any more.
+            vout << "Reading from file '" << options.inputfile << "'.\n";
+            const osmium::io::File infile{options.inputfile, options.input_format};
+
+            if (options.single_pass) {
+                vout << "Reading nodes and ways (single pass through input file)...\n";
+                vout << "  Using location cache file '" << options.location_cache << "'. (Change with the --location-cache/-L option.)\n";
+                read_nodes_and_ways(infile, options.location_cache, coastline_rings, *output_database);
+            } else {
+                vout << "Reading ways (1st pass through input file)...\n";
+                read_ways(infile, coastline_rings, vout);
+            }
+            coastline_rings.finish_assembly();
+            report_rings(coastline_rings, stats, vout);
+
+            // If the input file has node locations on ways (for instance
+            // created with "osmium add-locations-to-ways") we already have
+            // everything we need and don't have to read the nodes.
+            if (!options.single_pass) {
+                if (coastline_rings.num_ways() > 0 && coastline_rings.check_locations(false) == 0) {
+                    vout << "All node locations are on the ways, no need to read nodes (2nd pass through input file).\n";
+                } else {
+                    vout << "Reading nodes (2nd pass through input file)...\n";
+                    read_node_locations(infile, coastline_rings, *output_database, vout);
                 }
             }
         }
-        reader2.close();
     } catch (const std::exception& e) {
         std::cerr << e.what() << '\n';
         return return_code_fatal;
@@ -311,13 +637,36 @@ int main(int argc, char *argv[]) {
 
         vout << memory_usage();
 
+        if (!options.write_snapshot.empty()) {
+            vout << "Writing snapshot to file '" << options.write_snapshot << "' (because you used the --write-snapshot/-W option)...\n";
+            coastline_rings.write_snapshot(options.write_snapshot);
+        }
+
+        vout << "Compacting node locations...\n";
+        coastline_rings.compact_coordinates();
+        vout << memory_usage();
+
         output_database->set_options(options);
 
         vout << "Check line segments for intersections and overlaps...\n";
-        warnings += coastline_rings.check_for_intersections(*output_database, segments_fd);
+        std::size_t max_segments_in_memory = options.segment_memory * 1024UL * 1024UL / sizeof(osmium::UndirectedSegment);
+        if (options.max_segments_in_memory > 0) {
+            max_segments_in_memory = options.max_segments_in_memory;
+            vout << "  Keeping at most " << max_segments_in_memory << " segments in memory.\n";
+        } else if (max_segments_in_memory > 0) {
+            vout << "  Keeping at most " << options.segment_memory << " MBytes of segments in memory (set with --segment-memory/-M option).\n";
+        }
+        if (max_segments_in_memory > 0) {
+            vout << "  Temporary files are written to '" << options.temp_dir << "' (set with --temp-dir/-T option).\n";
+        }
+        if (!options.use_avx2) {
+            vout << "  Not using AVX2 instructions (because you used the --no-avx2 option).\n";
+            disable_avx2_intersections();
+        }
+        warnings += coastline_rings.check_for_intersections(*output_database, segment_writer.get(), max_segments_in_memory, options.min_segments_per_slab, options.temp_dir);
 
-        if (segments_fd != -1) {
-            ::close(segments_fd);
+        if (segment_writer) {
+            segment_writer->close();
         }
 
         vout << "Trying to close Antarctica ring...\n";
@@ -354,11 +703,14 @@ int main(int argc, char *argv[]) {
     if (options.output_polygons != output_polygon_type::none || options.output_lines) {
         try {
             vout << "Create polygons...\n";
-            CoastlinePolygons coastline_polygons{create_polygons(coastline_rings, *output_database, &warnings, &errors), \
+            unsigned int skipped_checks = 0;
+            CoastlinePolygons coastline_polygons{create_polygons(coastline_rings, *output_database, &warnings, &errors, &skipped_checks), \
                                                  *output_database, \
                                                  options.bbox_overlap, \
                                                  options.max_points_in_polygon};
 
+            vout << "  Skipped " << skipped_checks << " validity checks on polygons already known to be valid.\n";
+
             stats.land_polygons_before_split = coastline_polygons.num_polygons();
 
             vout << "Fixing coastlines going the wrong way...\n";
@@ -397,6 +749,7 @@ int main(int argc, char *argv[]) {
 
                 vout << "Checking and making polygons valid...\n";
                 warnings += coastline_polygons.check_polygons();
+                vout << "  Skipped " << coastline_polygons.num_skipped_checks() << " validity checks on polygons already known to be valid.\n";
 
                 if (options.output_polygons == output_polygon_type::land ||
                     options.output_polygons == output_polygon_type::both) {
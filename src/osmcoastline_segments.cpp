@@ -19,68 +19,47 @@
 
 */
 
+#include "dirty_tiles.hpp"
 #include "return_codes.hpp"
+#include "segment_file.hpp"
+#include "temp_file.hpp"
 #include "version.hpp"
 
+#include <osmium/osm/location.hpp>
 #include <osmium/osm/undirected_segment.hpp>
-#include <osmium/util/memory_mapping.hpp>
+#include <osmium/thread/pool.hpp>
 
 #include <gdalcpp.hpp>
 
 #include <algorithm>
 #include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <exception>
-#include <fcntl.h>
+#include <fstream>
+#include <future>
 #include <getopt.h>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <string>
-#include <sys/stat.h>
-#include <sys/types.h>
 #include <system_error>
 #include <utility>
 #include <vector>
 
-#ifndef _MSC_VER
-# include <unistd.h>
-#else
-# include <io.h>
-#endif
-
 using segvec = std::vector<osmium::UndirectedSegment>;
 
-class InputFile {
-
-    std::string m_filename;
-    int m_fd;
-
-public:
-
-    explicit InputFile(const std::string& filename) :
-        m_filename(filename),
-        m_fd(::open(filename.c_str(), O_RDONLY)) {
-        if (m_fd == -1) {
-            throw std::system_error{errno, std::system_category(), std::string{"Opening '"} + filename + "' failed"};
-        }
-    }
-
-    int fd() const noexcept {
-        return m_fd;
-    }
+namespace {
 
-    std::size_t size() const {
-        struct stat s; // NOLINT(cppcoreguidelines-pro-type-member-init, hicpp-member-init)
-        if (::fstat(m_fd, &s) != 0) {
-            throw std::system_error{errno, std::system_category(), std::string{"Can't get file size for '"} + m_filename + "'"};
-        }
-        return static_cast<std::size_t>(s.st_size);
-    }
+// How many ranges can be in the thread pool at the same time.
+const std::size_t max_queue_size = 20;
 
-}; // class InputFile
-
-namespace {
+// Number of segments read back from the spool file at a time.
+const std::size_t spool_chunk_size = 64UL * 1024UL;
 
 void print_help() {
 }
@@ -95,42 +74,266 @@ void add_segment(gdalcpp::Layer& layer, int change, const osmium::UndirectedSegm
     feature.add_to_layer();
 }
 
-void output_ogr(const std::string& filename, const std::string& driver_name, const segvec& removed_segments, const segvec& added_segments) {
-    gdalcpp::Dataset dataset{driver_name, filename};
-
-    gdalcpp::Layer layer{dataset, "changes", wkbLineString};
-    layer.add_field("change", OFTInteger, 1);
+void output_tiles(gdalcpp::Dataset& dataset, const DirtyTiles& tiles) {
+    gdalcpp::Layer layer{dataset, "tiles", wkbPolygon};
+    layer.add_field("zoom", OFTInteger, 2);
+    layer.add_field("x", OFTInteger, 10);
+    layer.add_field("y", OFTInteger, 10);
+    layer.add_field("removed", OFTInteger, 10);
+    layer.add_field("added", OFTInteger, 10);
     layer.start_transaction();
 
-    for (const auto& segment : removed_segments) {
-        add_segment(layer, 0, segment);
+    for (const auto& entry : tiles.tiles()) {
+        osmium::Location bottom_left;
+        osmium::Location top_right;
+        tiles.bounds(entry.first, &bottom_left, &top_right);
+
+        auto ring = std::make_unique<OGRLinearRing>();
+        ring->addPoint(bottom_left.lon(), bottom_left.lat());
+        ring->addPoint(bottom_left.lon(), top_right.lat());
+        ring->addPoint(top_right.lon(), top_right.lat());
+        ring->addPoint(top_right.lon(), bottom_left.lat());
+        ring->closeRings();
+
+        auto polygon = std::make_unique<OGRPolygon>();
+        polygon->addRingDirectly(ring.release());
+
+        gdalcpp::Feature feature(layer, std::move(polygon));
+        feature.set_field("zoom", static_cast<int>(tiles.zoom()));
+        feature.set_field("x", static_cast<int>(entry.first.x));
+        feature.set_field("y", static_cast<int>(entry.first.y));
+        feature.set_field("removed", static_cast<int>(entry.second.removed));
+        feature.set_field("added", static_cast<int>(entry.second.added));
+        feature.add_to_layer();
     }
 
-    for (const auto& segment : added_segments) {
-        add_segment(layer, 1, segment);
+    layer.commit_transaction();
+}
+
+/// Segments only in the first file (removed) and only in the second (added).
+struct diff_result {
+    segvec removed;
+    segvec added;
+};
+
+/**
+ * Read the segments from the file which are not smaller than begin and
+ * smaller than end. A nullptr for begin or end means there is no limit.
+ * Only the blocks which can contain such segments are read.
+ */
+segvec read_range(const SegmentFileReader& reader, const osmium::UndirectedSegment* begin, const osmium::UndirectedSegment* end) {
+    const auto& blocks = reader.blocks();
+
+    auto first = blocks.cbegin();
+    if (begin) {
+        first = std::partition_point(blocks.cbegin(), blocks.cend(), [&](const segment_file::block_info& block) {
+            return block.max < *begin;
+        });
     }
 
-    layer.commit_transaction();
+    auto last = blocks.cend();
+    if (end) {
+        last = std::partition_point(first, blocks.cend(), [&](const segment_file::block_info& block) {
+            return block.min < *end;
+        });
+    }
+
+    segvec segments;
+    for (auto it = first; it < last; ++it) {
+        reader.read_block(static_cast<std::size_t>(it - blocks.cbegin()), &segments);
+    }
+
+    if (end) {
+        segments.erase(std::lower_bound(segments.begin(), segments.end(), *end), segments.end());
+    }
+    if (begin) {
+        segments.erase(segments.begin(), std::lower_bound(segments.begin(), segments.end(), *begin));
+    }
+
+    return segments;
 }
 
+/**
+ * Compare the segments in the range [begin, end) of both files.
+ */
+diff_result diff_range(const SegmentFileReader& reader1, const SegmentFileReader& reader2, const osmium::UndirectedSegment* begin, const osmium::UndirectedSegment* end) {
+    const segvec segments1 = read_range(reader1, begin, end);
+    const segvec segments2 = read_range(reader2, begin, end);
+
+    diff_result result;
+    std::set_difference(segments1.cbegin(), segments1.cend(), segments2.cbegin(), segments2.cend(), std::back_inserter(result.removed));
+    std::set_difference(segments2.cbegin(), segments2.cend(), segments1.cbegin(), segments1.cend(), std::back_inserter(result.added));
+
+    return result;
+}
+
+/**
+ * Compares two segment files in parallel. The key space is split into
+ * ranges at the smallest segments of the blocks of both files. The
+ * ranges are compared independently in the thread pool of libosmium and
+ * the results are returned in order. Only a limited number of ranges are
+ * in the pool at the same time, so the memory use doesn't depend on the
+ * size of the files.
+ */
+class SegmentDiff {
+
+    const SegmentFileReader& m_reader1;
+    const SegmentFileReader& m_reader2;
+
+    // Range n is [m_bounds[n - 1], m_bounds[n]), the first and last range
+    // are open at the beginning and end, respectively.
+    segvec m_bounds;
+    std::size_t m_next_range = 0;
+
+    std::deque<std::future<diff_result>> m_queue;
+
+    std::size_t num_ranges() const noexcept {
+        return m_bounds.size() + 1;
+    }
+
+    void fill_queue() {
+        while (m_next_range < num_ranges() && m_queue.size() < max_queue_size) {
+            const osmium::UndirectedSegment* begin = m_next_range == 0 ? nullptr : &m_bounds[m_next_range - 1];
+            const osmium::UndirectedSegment* end = m_next_range == m_bounds.size() ? nullptr : &m_bounds[m_next_range];
+            m_queue.push_back(osmium::thread::Pool::default_instance().submit([this, begin, end]() {
+                return diff_range(m_reader1, m_reader2, begin, end);
+            }));
+            ++m_next_range;
+        }
+    }
+
+public:
+
+    SegmentDiff(const SegmentFileReader& reader1, const SegmentFileReader& reader2) :
+        m_reader1(reader1),
+        m_reader2(reader2) {
+        // Use the block starts of both files, so that no block of either
+        // file starts inside a range. So each range needs at most about
+        // one block of each file.
+        const auto& blocks1 = reader1.blocks();
+        const auto& blocks2 = reader2.blocks();
+        m_bounds.reserve(blocks1.size() + blocks2.size());
+        auto it1 = blocks1.cbegin();
+        auto it2 = blocks2.cbegin();
+        while (it1 != blocks1.cend() || it2 != blocks2.cend()) {
+            auto& it = (it2 == blocks2.cend() || (it1 != blocks1.cend() && it1->min < it2->min)) ? it1 : it2;
+            if (m_bounds.empty() || m_bounds.back() < it->min) {
+                m_bounds.push_back(it->min);
+            }
+            ++it;
+        }
+    }
+
+    SegmentDiff(const SegmentDiff&) = delete;
+    SegmentDiff& operator=(const SegmentDiff&) = delete;
+
+    SegmentDiff(SegmentDiff&&) = delete;
+    SegmentDiff& operator=(SegmentDiff&&) = delete;
+
+    ~SegmentDiff() noexcept {
+        // The tasks in the thread pool reference this object, so we have
+        // to wait for them before it can go away.
+        for (const auto& future : m_queue) {
+            if (future.valid()) {
+                future.wait();
+            }
+        }
+    }
+
+    /**
+     * Get the differences in the next range. Returns false after the
+     * last range.
+     */
+    bool next(diff_result* result) {
+        fill_queue();
+        if (m_queue.empty()) {
+            return false;
+        }
+
+        *result = m_queue.front().get();
+        m_queue.pop_front();
+        return true;
+    }
+
+}; // class SegmentDiff
+
+/**
+ * Temporary file (in the given directory) for segments which are written
+ * out later.
+ */
+class SegmentSpool {
+
+    std::FILE* m_file;
+
+public:
+
+    explicit SegmentSpool(const std::string& temp_dir) :
+        m_file(create_temp_file(temp_dir)) {
+    }
+
+    SegmentSpool(const SegmentSpool&) = delete;
+    SegmentSpool& operator=(const SegmentSpool&) = delete;
+
+    SegmentSpool(SegmentSpool&&) = delete;
+    SegmentSpool& operator=(SegmentSpool&&) = delete;
+
+    ~SegmentSpool() noexcept {
+        std::fclose(m_file);
+    }
+
+    void write(const segvec& segments) {
+        if (std::fwrite(segments.data(), sizeof(osmium::UndirectedSegment), segments.size(), m_file) != segments.size()) {
+            throw std::system_error{errno, std::system_category(), "Writing temporary file failed"};
+        }
+    }
+
+    /// Call the function with all segments written, in chunks.
+    template <typename TFunc>
+    void read(TFunc&& func) {
+        std::rewind(m_file);
+        segvec segments(spool_chunk_size, osmium::UndirectedSegment{osmium::Location{}, osmium::Location{}});
+        while (true) {
+            const auto count = std::fread(segments.data(), sizeof(osmium::UndirectedSegment), segments.size(), m_file);
+            if (count < segments.size() && std::ferror(m_file)) {
+                throw std::system_error{errno, std::system_category(), "Reading temporary file failed"};
+            }
+            if (count == 0) {
+                return;
+            }
+            for (std::size_t n = 0; n < count; ++n) {
+                func(segments[n]);
+            }
+        }
+    }
+
+}; // class SegmentSpool
+
 } // anonymous namespace
 
 int main(int argc, char *argv[]) {
     bool dump = false;
     std::string format = "ESRI Shapefile";
     std::string geom;
+    std::string tiles_file;
+    std::string temp_dir;
+    int zoom = -1;
+    int epsg = 3857;
 
     static struct option long_options[] = {
         {"dump",         no_argument, nullptr, 'd'},
         {"format", required_argument, nullptr, 'f'},
         {"geom",   required_argument, nullptr, 'g'},
         {"help",         no_argument, nullptr, 'h'},
+        {"srs",    required_argument, nullptr, 's'},
+        {"tiles",  required_argument, nullptr, 't'},
+        {"temp-dir", required_argument, nullptr, 'T'},
         {"version",      no_argument, nullptr, 'V'},
+        {"zoom",   required_argument, nullptr, 'z'},
         {nullptr,                  0, nullptr, 0}
     };
 
     while (true) {
-        const int c = getopt_long(argc, argv, "df:g:hV", long_options, nullptr);
+        const int c = getopt_long(argc, argv, "df:g:hs:t:T:Vz:", long_options, nullptr);
         if (c == -1) {
             break;
         }
@@ -150,6 +353,26 @@ int main(int argc, char *argv[]) {
                 print_help();
                 return return_code_ok;
             }
+            case 's':
+                epsg = std::atoi(optarg); // NOLINT(cert-err34-c) atoi is good enough for this use case
+                if (epsg != 3857 && epsg != 4326) {
+                    std::cerr << "Unknown SRS '" << optarg << "' for -s/--srs option. Use 3857 or 4326.\n";
+                    return return_code_cmdline;
+                }
+                break;
+            case 't':
+                tiles_file = optarg;
+                break;
+            case 'T':
+                temp_dir = optarg;
+                break;
+            case 'z':
+                zoom = std::atoi(optarg); // NOLINT(cert-err34-c) atoi is good enough for this use case
+                if (zoom < 0 || zoom > static_cast<int>(DirtyTiles::max_zoom)) {
+                    std::cerr << "Zoom level for -z/--zoom option must be between 0 and " << DirtyTiles::max_zoom << ".\n";
+                    return return_code_cmdline;
+                }
+                break;
             case 'V':
                 std::cout << "osmcoastline_segments " << get_osmcoastline_long_version() << " / " << get_libosmium_version() << '\n'
                           << "Copyright (C) 2012-2026  Jochen Topf <jochen@topf.org>\n"
@@ -167,34 +390,95 @@ int main(int argc, char *argv[]) {
         return return_code_cmdline;
     }
 
+    if (!tiles_file.empty() && zoom < 0) {
+        std::cerr << "The -t/--tiles option needs the -z/--zoom option.\n";
+        return return_code_cmdline;
+    }
+
     try {
-        segvec removed_segments;
-        segvec added_segments;
+        const SegmentFileReader reader1{argv[optind]};
+        const SegmentFileReader reader2{argv[optind + 1]};
+
+        std::unique_ptr<gdalcpp::Dataset> dataset;
+        std::unique_ptr<gdalcpp::Layer> layer;
+        if (!dump && !geom.empty()) {
+            dataset = std::make_unique<gdalcpp::Dataset>(format, geom);
+            layer = std::make_unique<gdalcpp::Layer>(*dataset, "changes", wkbLineString);
+            layer->add_field("change", OFTInteger, 1);
+            layer->start_transaction();
+        }
+
+        // When dumping, the removed segments are written out directly, the
+        // added segments are kept in a temporary file until the end.
+        std::unique_ptr<SegmentSpool> added_spool;
+        if (dump) {
+            std::cout << "Removed:\n";
+            added_spool = std::make_unique<SegmentSpool>(temp_dir.empty() ? default_temp_dir(argv[optind + 1]) : temp_dir);
+        }
 
-        const InputFile file1{argv[optind]};
-        const InputFile file2{argv[optind + 1]};
+        std::unique_ptr<DirtyTiles> dirty_tiles;
+        if (zoom >= 0) {
+            dirty_tiles = std::make_unique<DirtyTiles>(static_cast<uint32_t>(zoom), epsg);
+        }
 
-        const osmium::util::TypedMemoryMapping<osmium::UndirectedSegment> m1{file1.size() / sizeof(osmium::UndirectedSegment), osmium::util::MemoryMapping::mapping_mode::readonly, file1.fd()};
-        const osmium::util::TypedMemoryMapping<osmium::UndirectedSegment> m2{file2.size() / sizeof(osmium::UndirectedSegment), osmium::util::MemoryMapping::mapping_mode::readonly, file2.fd()};
+        bool different = false;
+        SegmentDiff diff{reader1, reader2};
+        diff_result result;
+        while (diff.next(&result)) {
+            if (result.removed.empty() && result.added.empty()) {
+                continue;
+            }
+            different = true;
+
+            if (dirty_tiles) {
+                for (const auto& segment : result.removed) {
+                    dirty_tiles->add(segment, false);
+                }
+                for (const auto& segment : result.added) {
+                    dirty_tiles->add(segment, true);
+                }
+            }
 
-        std::set_difference(m1.cbegin(), m1.cend(), m2.cbegin(), m2.cend(), std::back_inserter(removed_segments));
-        std::set_difference(m2.cbegin(), m2.cend(), m1.cbegin(), m1.cend(), std::back_inserter(added_segments));
+            if (dump) {
+                for (const auto& segment : result.removed) {
+                    std::cout << "  " << segment << "\n";
+                }
+                added_spool->write(result.added);
+            } else if (layer) {
+                for (const auto& segment : result.removed) {
+                    add_segment(*layer, 0, segment);
+                }
+                for (const auto& segment : result.added) {
+                    add_segment(*layer, 1, segment);
+                }
+            } else if (!dirty_tiles) {
+                // Only the return code is needed.
+                break;
+            }
+        }
 
         if (dump) {
-            std::cout << "Removed:\n";
-            for (const auto& segment : removed_segments) {
+            std::cout << "Added:\n";
+            added_spool->read([](const osmium::UndirectedSegment& segment) {
                 std::cout << "  " << segment << "\n";
+            });
+        } else if (layer) {
+            layer->commit_transaction();
+            if (dirty_tiles) {
+                output_tiles(*dataset, *dirty_tiles);
             }
+        }
 
-            std::cout << "Added:\n";
-            for (const auto& segment : added_segments) {
-                std::cout << "  " << segment << "\n";
+        if (!tiles_file.empty()) {
+            std::ofstream out{tiles_file};
+            dirty_tiles->write(out);
+            out.close();
+            if (!out) {
+                throw std::runtime_error{"Writing tiles file '" + tiles_file + "' failed"};
             }
-        } else if (!geom.empty()) {
-            output_ogr(geom, format, removed_segments, added_segments);
         }
 
-        return (removed_segments.empty() && added_segments.empty()) ? 0 : 1;
+        return different ? 1 : 0;
     } catch (const std::exception& e) {
         std::cerr << e.what() << '\n';
         return return_code_fatal;
@@ -19,6 +19,7 @@
 
 */
 
+#include "geos_geometry.hpp"
 #include "options.hpp"
 #include "output_database.hpp"
 #include "srs.hpp"
@@ -162,11 +163,14 @@ void OutputDatabase::add_error_line(std::unique_ptr<OGRLineString>&& linestring,
     feature.add_to_layer();
 }
 
-void OutputDatabase::add_ring(std::unique_ptr<OGRPolygon>&& polygon, osmium::object_id_type osm_id, unsigned int nways, unsigned int npoints, bool fixed) {
+bool OutputDatabase::add_ring(std::unique_ptr<OGRPolygon>&& polygon, osmium::object_id_type osm_id, unsigned int nways, unsigned int npoints, bool fixed) {
     m_srs.transform(polygon.get());
 
     const bool land = polygon->getExteriorRing()->isClockwise();
-    const bool valid = polygon->IsValid();
+
+    // Converted only once for the check and for finding the reason.
+    const auto geometry = to_geos(polygon.get());
+    const bool valid = GEOSisValid_r(geos_context(), geometry.get()) == 1;
 
     if (!valid) {
         /*
@@ -176,14 +180,12 @@ void OutputDatabase::add_ring(std::unique_ptr<OGRPolygon>&& polygon, osmium::obj
            point coordinates (of a self-intersection-point for instance) from
            this string and create a point in the error layer for it.
 
-           The exportToGEOS() method on OGR geometries is not documented. Let's
-           hope that it will always be available. We use the GEOSisValidReason()
-           function from the GEOS C interface to get to the reason.
+           We use the GEOSisValidReason_r() function from the GEOS C interface
+           to get to the reason.
         */
-        GEOSContextHandle_t contextHandle = OGRGeometry::createGEOSContext();
-        const char* const r = GEOSisValidReason(polygon->exportToGEOS(contextHandle));
+        char* const r = GEOSisValidReason_r(geos_context(), geometry.get());
         std::string reason = r ? r : "";
-        OGRGeometry::freeGEOSContext(contextHandle);
+        GEOSFree_r(geos_context(), r);
 
         if (!reason.empty()) {
             const std::size_t left_bracket = reason.find('[');
@@ -218,17 +220,21 @@ void OutputDatabase::add_ring(std::unique_ptr<OGRPolygon>&& polygon, osmium::obj
     feature.set_field("land", land);
     feature.set_field("valid", valid);
     feature.add_to_layer();
+
+    return valid;
 }
 
-void OutputDatabase::add_land_polygon(std::unique_ptr<OGRPolygon>&& polygon) {
-    m_srs.transform(polygon.get());
-    gdalcpp::Feature feature{m_layer_land_polygons, std::move(polygon)};
+void OutputDatabase::add_land_polygon(const GEOSGeometry* polygon) {
+    auto geometry = to_ogr(polygon);
+    geometry->assignSpatialReference(m_srs.out());
+    gdalcpp::Feature feature{m_layer_land_polygons, std::move(geometry)};
     feature.add_to_layer();
 }
 
-void OutputDatabase::add_water_polygon(std::unique_ptr<OGRPolygon>&& polygon) {
-    m_srs.transform(polygon.get());
-    gdalcpp::Feature feature{m_layer_water_polygons, std::move(polygon)};
+void OutputDatabase::add_water_polygon(const GEOSGeometry* polygon) {
+    auto geometry = to_ogr(polygon);
+    geometry->assignSpatialReference(m_srs.out());
+    gdalcpp::Feature feature{m_layer_water_polygons, std::move(geometry)};
     feature.add_to_layer();
 }
 
@@ -25,6 +25,7 @@
 #include <osmium/osm/types.hpp>
 
 #include <gdalcpp.hpp>
+#include <geos_c.h>
 
 #include <ctime>
 #include <memory>
@@ -90,9 +91,20 @@ public:
 
     void add_error_point(std::unique_ptr<OGRPoint>&& point, const char* error, osmium::object_id_type id = 0);
     void add_error_line(std::unique_ptr<OGRLineString>&& linestring, const char* error, osmium::object_id_type id = 0);
-    void add_ring(std::unique_ptr<OGRPolygon>&& polygon, osmium::object_id_type osm_id, unsigned int nways, unsigned int npoints, bool fixed);
-    void add_land_polygon(std::unique_ptr<OGRPolygon>&& polygon);
-    void add_water_polygon(std::unique_ptr<OGRPolygon>&& polygon);
+
+    /**
+     * Add ring to the rings layer. Returns true if the ring (in the output
+     * SRS) is valid.
+     */
+    bool add_ring(std::unique_ptr<OGRPolygon>&& polygon, osmium::object_id_type osm_id, unsigned int nways, unsigned int npoints, bool fixed);
+
+    /**
+     * Add land or water polygon. The polygons are GEOS geometries in the
+     * output SRS, they are converted to OGR geometries here.
+     */
+    void add_land_polygon(const GEOSGeometry* polygon);
+    void add_water_polygon(const GEOSGeometry* polygon);
+
     void add_line(std::unique_ptr<OGRLineString>&& linestring);
 
     void set_options(const Options& options);
@@ -0,0 +1,171 @@
+#ifndef PACKED_RTREE_HPP
+#define PACKED_RTREE_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Static R-tree of integer boxes with attached values, bulk loaded with
+ * the Sort-Tile-Recursive (STR) algorithm.
+ *
+ * On each level the nodes are sorted by the x coordinate of their center,
+ * cut into vertical slices, and each slice is sorted by the y coordinate
+ * of the center. Consecutive runs of node_size nodes then get a common
+ * parent on the next level. Call add() for all boxes, then build() once
+ * before querying.
+ */
+class PackedRTree {
+
+public:
+
+    struct box {
+        int32_t min_x;
+        int32_t min_y;
+        int32_t max_x;
+        int32_t max_y;
+
+        bool contains(const box& other) const noexcept {
+            return min_x <= other.min_x && min_y <= other.min_y &&
+                   max_x >= other.max_x && max_y >= other.max_y;
+        }
+
+        void extend(const box& other) noexcept {
+            min_x = std::min(min_x, other.min_x);
+            min_y = std::min(min_y, other.min_y);
+            max_x = std::max(max_x, other.max_x);
+            max_y = std::max(max_y, other.max_y);
+        }
+
+        // Twice the center, so it is still an integer.
+        int64_t center_x() const noexcept {
+            return static_cast<int64_t>(min_x) + max_x;
+        }
+
+        int64_t center_y() const noexcept {
+            return static_cast<int64_t>(min_y) + max_y;
+        }
+    };
+
+    static constexpr const std::size_t node_size = 16;
+
+private:
+
+    // On level 0 (the items) first is the value, on all other levels the
+    // children are [first, last) on the level below.
+    struct node {
+        box bbox;
+        std::size_t first;
+        std::size_t last;
+    };
+
+    std::vector<std::vector<node>> m_levels{1};
+
+    static void sort_tiles(std::vector<node>& nodes) {
+        std::sort(nodes.begin(), nodes.end(), [](const node& a, const node& b) {
+            return a.bbox.center_x() < b.bbox.center_x();
+        });
+
+        const std::size_t num_parents = (nodes.size() + node_size - 1) / node_size;
+        const auto num_slices = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(num_parents))));
+        const std::size_t slice_size = num_slices * node_size;
+
+        for (std::size_t begin = 0; begin < nodes.size(); begin += slice_size) {
+            const auto end = nodes.begin() + static_cast<std::ptrdiff_t>(std::min(begin + slice_size, nodes.size()));
+            std::sort(nodes.begin() + static_cast<std::ptrdiff_t>(begin), end, [](const node& a, const node& b) {
+                return a.bbox.center_y() < b.bbox.center_y();
+            });
+        }
+    }
+
+    template <typename TFunc>
+    void query(std::size_t level, std::size_t n, const box& b, TFunc&& func) const {
+        const node& nd = m_levels[level][n];
+        if (!nd.bbox.contains(b)) {
+            return;
+        }
+        if (level == 0) {
+            func(nd.first);
+            return;
+        }
+        for (std::size_t child = nd.first; child < nd.last; ++child) {
+            query(level - 1, child, b, func);
+        }
+    }
+
+public:
+
+    PackedRTree() = default;
+
+    std::size_t size() const noexcept {
+        return m_levels.front().size();
+    }
+
+    void reserve(std::size_t size) {
+        m_levels.front().reserve(size);
+    }
+
+    void add(const box& b, std::size_t value) {
+        assert(m_levels.size() == 1);
+        m_levels.front().push_back(node{b, value, 0});
+    }
+
+    void build() {
+        assert(m_levels.size() == 1);
+        while (m_levels.back().size() > 1) {
+            auto& nodes = m_levels.back();
+            sort_tiles(nodes);
+
+            std::vector<node> parents;
+            parents.reserve((nodes.size() + node_size - 1) / node_size);
+            for (std::size_t begin = 0; begin < nodes.size(); begin += node_size) {
+                const std::size_t end = std::min(begin + node_size, nodes.size());
+                node parent{nodes[begin].bbox, begin, end};
+                for (std::size_t n = begin + 1; n < end; ++n) {
+                    parent.bbox.extend(nodes[n].bbox);
+                }
+                parents.push_back(parent);
+            }
+            m_levels.push_back(std::move(parents));
+        }
+    }
+
+    /**
+     * Call func(value) for all boxes that contain the given box. The
+     * order of the calls is unspecified.
+     */
+    template <typename TFunc>
+    void query_containing(const box& b, TFunc&& func) const {
+        if (m_levels.back().empty()) {
+            return;
+        }
+        query(m_levels.size() - 1, 0, b, func);
+    }
+
+}; // class PackedRTree
+
+#endif // PACKED_RTREE_HPP
@@ -0,0 +1,247 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "pbf_block_reader.hpp"
+
+#include <osmium/io/detail/pbf_decoder.hpp>
+#include <osmium/io/file.hpp>
+#include <osmium/io/file_compression.hpp>
+#include <osmium/io/file_format.hpp>
+#include <osmium/thread/pool.hpp>
+
+#include <protozero/pbf_reader.hpp>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#ifndef _MSC_VER
+# include <unistd.h>
+#else
+# include <io.h>
+#endif
+
+namespace {
+
+// Limits from the PBF format specification.
+const std::size_t max_blob_header_size = 64UL * 1024UL;
+const std::size_t max_uncompressed_blob_size = 32UL * 1024UL * 1024UL;
+
+// How many blocks can be in the thread pool at the same time.
+const std::size_t max_queue_size = 20;
+
+} // anonymous namespace
+
+bool string_table_contains(protozero::data_view block, const char* str) {
+    const std::size_t len = std::strlen(str);
+
+    protozero::pbf_reader pbf_block{block};
+    // PrimitiveBlock.stringtable
+    if (pbf_block.next(1, protozero::pbf_wire_type::length_delimited)) {
+        protozero::pbf_reader pbf_string_table{pbf_block.get_message()};
+        // StringTable.s
+        while (pbf_string_table.next(1, protozero::pbf_wire_type::length_delimited)) {
+            const auto s = pbf_string_table.get_view();
+            if (s.size() == len && std::memcmp(s.data(), str, len) == 0) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+PBFBlockReader::PBFBlockReader(const std::string& filename, osmium::osm_entity_bits::type entities, filter_func_type filter, transform_func_type transform) :
+    m_filename(filename),
+    m_fd(::open(filename.c_str(), O_RDONLY)), // NOLINT(hicpp-signed-bitwise)
+    m_entities(entities),
+    m_filter(std::move(filter)),
+    m_transform(std::move(transform)) {
+    if (m_fd.get() == -1) {
+        throw std::system_error{errno, std::system_category(), std::string{"Opening '"} + filename + "' failed"};
+    }
+
+    std::string type;
+    std::string blob;
+    if (!read_blob(&type, &blob) || type != "OSMHeader") {
+        throw std::runtime_error{"PBF file '" + m_filename + "' doesn't start with an OSMHeader"};
+    }
+
+    // This throws if the file needs features libosmium doesn't support.
+    m_header = osmium::io::detail::decode_header(blob);
+}
+
+PBFBlockReader::~PBFBlockReader() noexcept {
+    // The tasks in the thread pool reference this object, so we have to
+    // wait for them before it can go away.
+    for (const auto& future : m_queue) {
+        if (future.valid()) {
+            future.wait();
+        }
+    }
+}
+
+bool PBFBlockReader::can_read(const osmium::io::File& file) {
+    return file.format() == osmium::io::file_format::pbf &&
+           file.compression() == osmium::io::file_compression::none &&
+           !file.filename().empty() &&
+           file.filename() != "-";
+}
+
+bool PBFBlockReader::read_exactly(char* buffer, std::size_t size) {
+    std::size_t done = 0;
+    while (done < size) {
+#ifndef _MSC_VER
+        const auto nread = ::read(m_fd.get(), buffer + done, size - done);
+#else
+        const auto nread = _read(m_fd.get(), buffer + done, static_cast<unsigned int>(size - done));
+#endif
+        if (nread < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error{errno, std::system_category(), std::string{"Read error on '"} + m_filename + "'"};
+        }
+        if (nread == 0) {
+            if (done == 0) {
+                return false;
+            }
+            throw std::runtime_error{"Truncated PBF file '" + m_filename + "'"};
+        }
+        done += static_cast<std::size_t>(nread);
+    }
+    return true;
+}
+
+/**
+ * Read the next blob and its type from the file. Returns false at the end
+ * of the file.
+ */
+bool PBFBlockReader::read_blob(std::string* type, std::string* blob) {
+    std::array<unsigned char, 4> size_buffer{};
+    if (!read_exactly(reinterpret_cast<char*>(size_buffer.data()), size_buffer.size())) { // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        return false;
+    }
+
+    const std::size_t header_size = (static_cast<uint32_t>(size_buffer[0]) << 24U) |
+                                    (static_cast<uint32_t>(size_buffer[1]) << 16U) |
+                                    (static_cast<uint32_t>(size_buffer[2]) <<  8U) |
+                                     static_cast<uint32_t>(size_buffer[3]);
+    if (header_size > max_blob_header_size) {
+        throw std::runtime_error{"Invalid BlobHeader size in PBF file '" + m_filename + "'"};
+    }
+
+    std::string header(header_size, '\0');
+    if (!read_exactly(&header[0], header_size)) {
+        throw std::runtime_error{"Truncated PBF file '" + m_filename + "'"};
+    }
+
+    protozero::data_view blob_type{};
+    int32_t datasize = -1;
+    protozero::pbf_reader pbf_header{header};
+    while (pbf_header.next()) {
+        if (pbf_header.tag() == 1 && pbf_header.wire_type() == protozero::pbf_wire_type::length_delimited) {
+            blob_type = pbf_header.get_view();
+        } else if (pbf_header.tag() == 3 && pbf_header.wire_type() == protozero::pbf_wire_type::varint) {
+            datasize = pbf_header.get_int32();
+        } else {
+            pbf_header.skip();
+        }
+    }
+
+    if (datasize < 0 || static_cast<std::size_t>(datasize) > max_uncompressed_blob_size) {
+        throw std::runtime_error{"Invalid blob size in PBF file '" + m_filename + "'"};
+    }
+
+    blob->resize(static_cast<std::size_t>(datasize));
+    if (datasize > 0 && !read_exactly(&(*blob)[0], blob->size())) {
+        throw std::runtime_error{"Truncated PBF file '" + m_filename + "'"};
+    }
+
+    type->assign(blob_type.data(), blob_type.size());
+    return true;
+}
+
+/**
+ * Read the next OSMData blob from the file. Other (unknown) blobs are
+ * skipped. Returns false at the end of the file.
+ */
+bool PBFBlockReader::read_data_blob(std::string* blob) {
+    std::string type;
+    while (read_blob(&type, blob)) {
+        if (type == "OSMData") {
+            return true;
+        }
+    }
+    return false;
+}
+
+PBFBlockReader::block_result PBFBlockReader::decode_block(const std::string& blob) const {
+    std::string output;
+    const protozero::data_view data = osmium::io::detail::decode_blob(blob, output);
+
+    if (!m_filter(data)) {
+        return {osmium::memory::Buffer{}, true};
+    }
+
+    osmium::io::detail::PBFPrimitiveBlockDecoder decoder{data, m_entities, osmium::io::read_meta::no};
+    if (m_transform) {
+        return {m_transform(decoder()), false};
+    }
+    return {decoder(), false};
+}
+
+void PBFBlockReader::fill_queue() {
+    while (!m_eof && m_queue.size() < max_queue_size) {
+        std::string blob;
+        if (!read_data_blob(&blob)) {
+            m_eof = true;
+            return;
+        }
+        m_queue.push_back(osmium::thread::Pool::default_instance().submit([this, blob = std::move(blob)]() {
+            return decode_block(blob);
+        }));
+    }
+}
+
+osmium::memory::Buffer PBFBlockReader::read() {
+    while (true) {
+        fill_queue();
+        if (m_queue.empty()) {
+            return osmium::memory::Buffer{};
+        }
+
+        block_result result = m_queue.front().get();
+        m_queue.pop_front();
+        ++m_blocks;
+
+        if (!result.skipped) {
+            return std::move(result.buffer);
+        }
+        ++m_skipped_blocks;
+    }
+}
@@ -0,0 +1,194 @@
+#ifndef PBF_BLOCK_READER_HPP
+#define PBF_BLOCK_READER_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "file_descriptor.hpp"
+
+#include <osmium/io/file.hpp>
+#include <osmium/io/header.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <protozero/data_view.hpp>
+#include <protozero/pbf_reader.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <string>
+
+/**
+ * Returns true if the string table of the (uncompressed) PBF
+ * PrimitiveBlock contains the given string.
+ */
+bool string_table_contains(protozero::data_view block, const char* str);
+
+/**
+ * Calls the function with the IDs of all nodes in the DenseNodes groups of
+ * the (uncompressed) PBF PrimitiveBlock until it returns true. Only the ID
+ * column is decoded for this. Returns true if the function returned true
+ * for any ID or if the block contains non-dense nodes which are not
+ * checked.
+ */
+template <typename TFunc>
+bool any_node_id(protozero::data_view block, TFunc&& func) {
+    protozero::pbf_reader pbf_block{block};
+    // PrimitiveBlock.primitivegroup
+    while (pbf_block.next(2, protozero::pbf_wire_type::length_delimited)) {
+        protozero::pbf_reader pbf_group{pbf_block.get_message()};
+        while (pbf_group.next()) {
+            if (pbf_group.tag() == 1) { // PrimitiveGroup.nodes
+                return true;
+            }
+            if (pbf_group.tag() == 2 && pbf_group.wire_type() == protozero::pbf_wire_type::length_delimited) { // PrimitiveGroup.dense
+                protozero::pbf_reader pbf_dense{pbf_group.get_message()};
+                // DenseNodes.id
+                while (pbf_dense.next(1, protozero::pbf_wire_type::length_delimited)) {
+                    osmium::object_id_type id = 0;
+                    for (const auto delta : pbf_dense.get_packed_sint64()) {
+                        id += delta;
+                        if (func(id)) {
+                            return true;
+                        }
+                    }
+                }
+            } else {
+                pbf_group.skip();
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Reader for uncompressed PBF files that looks at each PrimitiveBlock
+ * before decoding it. Only those blocks the filter function is interested
+ * in are decoded into OSM objects, all other blocks are skipped after
+ * decompression.
+ *
+ * Decompression, filtering and decoding is done in the thread pool of
+ * libosmium, the buffers are returned in the order of the blocks in the
+ * file. Optionally the decoded buffers can be transformed (for instance to
+ * only keep some objects) in the thread pool, too.
+ *
+ * The OSMHeader is decoded and checked by libosmium like the
+ * osmium::io::Reader does it, so files with required features libosmium
+ * doesn't support are rejected.
+ *
+ * This uses the PBF decoding functions from the osmium::io::detail
+ * namespace of libosmium (decode_header(), decode_blob(), and
+ * PBFPrimitiveBlockDecoder with the read_meta parameter), which are not
+ * part of the public API. They are available in the libosmium versions
+ * required in CMakeLists.txt.
+ */
+class PBFBlockReader {
+
+public:
+
+    /**
+     * The filter function gets the uncompressed PrimitiveBlock and returns
+     * true if the block should be decoded. It is called from several
+     * threads at the same time.
+     */
+    using filter_func_type = std::function<bool(protozero::data_view)>;
+
+    /**
+     * The transform function gets the decoded buffer and returns the
+     * buffer that should be returned from read() instead. It is called
+     * from several threads at the same time.
+     */
+    using transform_func_type = std::function<osmium::memory::Buffer(const osmium::memory::Buffer&)>;
+
+private:
+
+    struct block_result {
+        osmium::memory::Buffer buffer;
+        bool skipped;
+    };
+
+    std::string m_filename;
+    FileDescriptor m_fd;
+    osmium::io::Header m_header;
+    osmium::osm_entity_bits::type m_entities;
+    filter_func_type m_filter;
+    transform_func_type m_transform;
+    std::deque<std::future<block_result>> m_queue;
+    std::size_t m_blocks = 0;
+    std::size_t m_skipped_blocks = 0;
+    bool m_eof = false;
+
+    bool read_exactly(char* buffer, std::size_t size);
+    bool read_blob(std::string* type, std::string* blob);
+    bool read_data_blob(std::string* blob);
+    void fill_queue();
+    block_result decode_block(const std::string& blob) const;
+
+public:
+
+    /**
+     * Open the file and read the OSMHeader. Throws if the file doesn't
+     * start with an OSMHeader or if it needs features not supported by
+     * libosmium.
+     */
+    PBFBlockReader(const std::string& filename, osmium::osm_entity_bits::type entities, filter_func_type filter, transform_func_type transform = nullptr);
+
+    PBFBlockReader(const PBFBlockReader&) = delete;
+    PBFBlockReader& operator=(const PBFBlockReader&) = delete;
+
+    PBFBlockReader(PBFBlockReader&&) = delete;
+    PBFBlockReader& operator=(PBFBlockReader&&) = delete;
+
+    ~PBFBlockReader() noexcept;
+
+    /**
+     * Can this reader be used for the given file? It only works for
+     * uncompressed PBF files which are not read from STDIN.
+     */
+    static bool can_read(const osmium::io::File& file);
+
+    /// The header of the file.
+    const osmium::io::Header& header() const noexcept {
+        return m_header;
+    }
+
+    /**
+     * Read the next buffer. Returns an invalid buffer at the end of the
+     * file.
+     */
+    osmium::memory::Buffer read();
+
+    /// Number of data blocks read so far.
+    std::size_t num_blocks() const noexcept {
+        return m_blocks;
+    }
+
+    /// Number of data blocks that were not decoded because of the filter.
+    std::size_t num_skipped_blocks() const noexcept {
+        return m_skipped_blocks;
+    }
+
+}; // class PBFBlockReader
+
+#endif // PBF_BLOCK_READER_HPP
@@ -0,0 +1,380 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "polygon_nesting.hpp"
+#include "packed_rtree.hpp"
+
+#include <osmium/osm/location.hpp>
+#include <osmium/thread/pool.hpp>
+
+#include <ogr_geometry.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+ * The point-in-ring tests below work on the fixed-point coordinates of
+ * osmium::Location. The points tested are either vertices or the middle
+ * of an edge, so all points are given with doubled coordinates to keep
+ * them integers. Differences between doubled x coordinates fit into 34
+ * bits, the products in the orientation tests need up to 64 bits without
+ * the sign. So they are compared as signs and unsigned magnitudes.
+ */
+
+namespace {
+
+// Rings with fewer points are searched edge by edge.
+constexpr const std::size_t min_points_for_bands = 256;
+
+// Average number of edges per band in the band index of a ring.
+constexpr const std::size_t edges_per_band = 16;
+
+// Number of rings handled in one task in the thread pool.
+constexpr const std::size_t rings_per_task = 256;
+
+constexpr const std::size_t no_container = std::numeric_limits<std::size_t>::max();
+
+int sign(int64_t value) noexcept {
+    return static_cast<int>(value > 0) - static_cast<int>(value < 0);
+}
+
+uint64_t magnitude(int64_t value) noexcept {
+    return value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+}
+
+/// Sign of a * b - c * d. The products must fit into 64 bits unsigned.
+int compare_products(int64_t a, int64_t b, int64_t c, int64_t d) noexcept {
+    const int sp = sign(a) * sign(b);
+    const int sq = sign(c) * sign(d);
+    if (sp != sq) {
+        return sp > sq ? 1 : -1;
+    }
+    if (sp == 0) {
+        return 0;
+    }
+    const uint64_t p = magnitude(a) * magnitude(b);
+    const uint64_t q = magnitude(c) * magnitude(d);
+    if (p == q) {
+        return 0;
+    }
+    return (p > q) == (sp > 0) ? 1 : -1;
+}
+
+/**
+ * The outer ring of a polygon with fixed-point coordinates. Large rings
+ * get an index of the edges crossing each horizontal band of the bounding
+ * box, so point-in-ring tests only have to look at the edges in one band.
+ */
+class Ring {
+
+    std::vector<osmium::Location> m_locations;
+    PackedRTree::box m_bbox{};
+
+    // Edges (by index of their first location) crossing band n are
+    // m_band_edges[m_band_offsets[n]] to m_band_edges[m_band_offsets[n + 1] - 1].
+    std::vector<std::size_t> m_band_offsets;
+    std::vector<std::size_t> m_band_edges;
+    int64_t m_band_height = 0;
+
+    int64_t band(int64_t y) const noexcept {
+        return (y - m_bbox.min_y) / m_band_height;
+    }
+
+    /**
+     * Check the edge starting at location n against the point. Returns
+     * true if the point is on the edge, otherwise increments crossings
+     * if a ray from the point in positive x direction crosses the edge.
+     */
+    bool check_edge(std::size_t n, int64_t x2, int64_t y2, std::size_t* crossings) const noexcept {
+        const osmium::Location a = m_locations[n];
+        const osmium::Location b = m_locations[n + 1];
+        const int64_t ax2 = 2 * static_cast<int64_t>(a.x());
+        const int64_t ay2 = 2 * static_cast<int64_t>(a.y());
+        const int64_t bx2 = 2 * static_cast<int64_t>(b.x());
+        const int64_t by2 = 2 * static_cast<int64_t>(b.y());
+
+        const int orientation = compare_products(static_cast<int64_t>(b.x()) - a.x(), y2 - ay2,
+                                                 static_cast<int64_t>(b.y()) - a.y(), x2 - ax2);
+
+        if (orientation == 0 &&
+            x2 >= std::min(ax2, bx2) && x2 <= std::max(ax2, bx2) &&
+            y2 >= std::min(ay2, by2) && y2 <= std::max(ay2, by2)) {
+            return true;
+        }
+
+        if ((ay2 > y2) != (by2 > y2)) {
+            // The crossing is on the right of the point if the point is
+            // on the left of an upward edge or on the right of a downward
+            // edge.
+            if (by2 > ay2 ? orientation > 0 : orientation < 0) {
+                ++*crossings;
+            }
+        }
+
+        return false;
+    }
+
+public:
+
+    explicit Ring(const OGRLinearRing& ring) {
+        const int num_points = ring.getNumPoints();
+        m_locations.reserve(static_cast<std::size_t>(num_points));
+        for (int n = 0; n < num_points; ++n) {
+            m_locations.emplace_back(ring.getX(n), ring.getY(n));
+        }
+
+        assert(!m_locations.empty());
+        m_bbox = PackedRTree::box{m_locations.front().x(), m_locations.front().y(),
+                                  m_locations.front().x(), m_locations.front().y()};
+        for (const auto& location : m_locations) {
+            m_bbox.extend(PackedRTree::box{location.x(), location.y(), location.x(), location.y()});
+        }
+    }
+
+    const PackedRTree::box& bbox() const noexcept {
+        return m_bbox;
+    }
+
+    const std::vector<osmium::Location>& locations() const noexcept {
+        return m_locations;
+    }
+
+    void build_band_index() {
+        if (m_locations.size() < min_points_for_bands) {
+            return;
+        }
+
+        const std::size_t num_edges = m_locations.size() - 1;
+        const std::size_t num_bands = num_edges / edges_per_band;
+        m_band_height = (static_cast<int64_t>(m_bbox.max_y) - m_bbox.min_y) / static_cast<int64_t>(num_bands) + 1;
+
+        const auto edge_bands = [this](std::size_t n) {
+            const int32_t y1 = m_locations[n].y();
+            const int32_t y2 = m_locations[n + 1].y();
+            return std::make_pair(static_cast<std::size_t>(band(std::min(y1, y2))),
+                                  static_cast<std::size_t>(band(std::max(y1, y2))));
+        };
+
+        m_band_offsets.assign(num_bands + 1, 0);
+        for (std::size_t n = 0; n < num_edges; ++n) {
+            const auto bands = edge_bands(n);
+            for (std::size_t b = bands.first; b <= bands.second; ++b) {
+                ++m_band_offsets[b + 1];
+            }
+        }
+        std::partial_sum(m_band_offsets.begin(), m_band_offsets.end(), m_band_offsets.begin());
+
+        m_band_edges.resize(m_band_offsets.back());
+        std::vector<std::size_t> fill(m_band_offsets.begin(), m_band_offsets.end() - 1);
+        for (std::size_t n = 0; n < num_edges; ++n) {
+            const auto bands = edge_bands(n);
+            for (std::size_t b = bands.first; b <= bands.second; ++b) {
+                m_band_edges[fill[b]++] = n;
+            }
+        }
+    }
+
+    /**
+     * Where is the point (given with doubled coordinates) in relation to
+     * this ring? Returns 1 if it is inside, 0 if it is on the boundary,
+     * and -1 if it is outside.
+     */
+    int locate(int64_t x2, int64_t y2) const noexcept {
+        if (x2 < 2 * static_cast<int64_t>(m_bbox.min_x) || x2 > 2 * static_cast<int64_t>(m_bbox.max_x) ||
+            y2 < 2 * static_cast<int64_t>(m_bbox.min_y) || y2 > 2 * static_cast<int64_t>(m_bbox.max_y)) {
+            return -1;
+        }
+
+        std::size_t crossings = 0;
+        if (m_band_offsets.empty()) {
+            for (std::size_t n = 0; n + 1 < m_locations.size(); ++n) {
+                if (check_edge(n, x2, y2, &crossings)) {
+                    return 0;
+                }
+            }
+        } else {
+            // All edges crossing or touching the horizontal line through
+            // the point are in its band. If the point is between two
+            // integer y coordinates, those edges are in the band of the
+            // lower one, too.
+            const auto b = static_cast<std::size_t>((y2 - 2 * static_cast<int64_t>(m_bbox.min_y)) / (2 * m_band_height));
+            for (std::size_t i = m_band_offsets[b]; i < m_band_offsets[b + 1]; ++i) {
+                if (check_edge(m_band_edges[i], x2, y2, &crossings)) {
+                    return 0;
+                }
+            }
+        }
+
+        return (crossings & 1U) ? 1 : -1;
+    }
+
+}; // class Ring
+
+/**
+ * Is the ring inside the other ring? The first vertex of the ring that
+ * is not on the boundary of the other ring decides. If all vertices are
+ * on the boundary, the middle of the first edge decides.
+ */
+bool is_inside(const Ring& ring, const Ring& other) noexcept {
+    const auto& locations = ring.locations();
+    for (const auto& location : locations) {
+        const int where = other.locate(2 * static_cast<int64_t>(location.x()),
+                                       2 * static_cast<int64_t>(location.y()));
+        if (where != 0) {
+            return where > 0;
+        }
+    }
+
+    if (locations.size() < 2) {
+        return false;
+    }
+
+    return other.locate(static_cast<int64_t>(locations[0].x()) + locations[1].x(),
+                        static_cast<int64_t>(locations[0].y()) + locations[1].y()) > 0;
+}
+
+/**
+ * Call func(begin, end) for consecutive ranges of [0, size) in the
+ * thread pool and wait for all of them.
+ */
+template <typename TFunc>
+void run_in_pool(std::size_t size, TFunc&& func) {
+    std::vector<std::future<void>> futures;
+    futures.reserve(size / rings_per_task + 1);
+    for (std::size_t begin = 0; begin < size; begin += rings_per_task) {
+        const std::size_t end = std::min(begin + rings_per_task, size);
+        futures.push_back(osmium::thread::Pool::default_instance().submit([&func, begin, end]() {
+            func(begin, end);
+        }));
+    }
+
+    // Wait for all tasks before get() can throw, they reference the rings.
+    for (const auto& future : futures) {
+        future.wait();
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+}
+
+} // anonymous namespace
+
+polygon_vector_type nest_polygons(polygon_vector_type&& polygons) {
+    const std::size_t size = polygons.size();
+
+    std::vector<Ring> rings;
+    std::vector<double> areas;
+    std::vector<std::size_t> land;
+    std::vector<std::size_t> holes;
+    rings.reserve(size);
+    areas.reserve(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        const OGRLinearRing* ring = polygons[n]->getExteriorRing();
+        if (!ring || ring->getNumPoints() == 0 || polygons[n]->getNumInteriorRings() != 0) {
+            throw std::runtime_error{"Polygons to be nested must have an outer ring and no holes"};
+        }
+        rings.emplace_back(*ring);
+        areas.push_back(ring->get_Area());
+        if (ring->isClockwise()) {
+            land.push_back(n);
+        } else {
+            holes.push_back(n);
+        }
+    }
+
+    // Order polygons by decreasing area. A hole can only be in a polygon
+    // that comes before it in this order.
+    std::vector<std::size_t> order(size);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&areas](std::size_t a, std::size_t b) {
+        return areas[a] > areas[b];
+    });
+    std::vector<std::size_t> rank(size);
+    for (std::size_t r = 0; r < size; ++r) {
+        rank[order[r]] = r;
+    }
+
+    PackedRTree tree;
+    tree.reserve(land.size());
+    for (const auto n : land) {
+        tree.add(rings[n].bbox(), n);
+    }
+    tree.build();
+
+    run_in_pool(land.size(), [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            rings[land[i]].build_band_index();
+        }
+    });
+
+    // Find the smallest land polygon containing each hole.
+    std::vector<std::size_t> container(size, no_container);
+    run_in_pool(holes.size(), [&](std::size_t begin, std::size_t end) {
+        std::vector<std::size_t> candidates;
+        for (std::size_t i = begin; i < end; ++i) {
+            const std::size_t hole = holes[i];
+            candidates.clear();
+            tree.query_containing(rings[hole].bbox(), [&](std::size_t n) {
+                if (rank[n] < rank[hole]) {
+                    candidates.push_back(n);
+                }
+            });
+            std::sort(candidates.begin(), candidates.end(), [&rank](std::size_t a, std::size_t b) {
+                return rank[a] > rank[b];
+            });
+            for (const auto n : candidates) {
+                if (is_inside(rings[hole], rings[n])) {
+                    container[hole] = n;
+                    break;
+                }
+            }
+        }
+    });
+
+    // The holes are added to their polygons in the order of decreasing
+    // area, too. Only the rings were checked for validity, so polygons
+    // with holes have to be checked again.
+    for (const auto n : order) {
+        if (container[n] != no_container) {
+            auto& polygon = polygons[container[n]];
+            polygon->addRingDirectly(polygons[n]->stealExteriorRing());
+            polygon.valid = validity::unknown;
+            polygons[n].polygon.reset();
+        }
+    }
+
+    polygon_vector_type result;
+    for (const auto n : order) {
+        if (polygons[n]) {
+            result.push_back(std::move(polygons[n]));
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,48 @@
+#ifndef POLYGON_NESTING_HPP
+#define POLYGON_NESTING_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "coastline_polygons.hpp"
+
+/**
+ * Assemble the polygons created from the coastline rings into polygons
+ * with holes. The polygons must not have holes themselves, otherwise
+ * std::runtime_error is thrown.
+ *
+ * Polygons with clockwise outer rings are land, polygons with counter-
+ * clockwise outer rings are holes. Each hole is put into the smallest
+ * (by area) land polygon that contains it. Holes that aren't inside
+ * any land polygon are returned as polygons of their own. This is the
+ * same as the "ONLY_CCW" method of OGRGeometryFactory::organizePolygons().
+ *
+ * Candidates for the containing polygon are found with an R-tree of the
+ * bounding boxes of the land polygons, the candidates are then checked
+ * with exact point-in-ring tests on the fixed-point coordinates. The holes
+ * are checked in parallel.
+ *
+ * The resulting polygons are ordered by decreasing area of their outer
+ * ring, the holes in each polygon, too.
+ */
+polygon_vector_type nest_polygons(polygon_vector_type&& polygons);
+
+#endif // POLYGON_NESTING_HPP
@@ -0,0 +1,436 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_file.hpp"
+
+#include <osmium/osm/location.hpp>
+#include <osmium/thread/pool.hpp>
+#include <osmium/util/memory_mapping.hpp>
+
+#include <protozero/exception.hpp>
+#include <protozero/varint.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <system_error>
+#include <utility>
+
+#ifndef _MSC_VER
+# include <unistd.h>
+#else
+# include <io.h>
+#endif
+
+namespace {
+
+// How many blocks can be in the thread pool at the same time.
+const std::size_t max_queue_size = 20;
+
+const std::size_t header_size = sizeof(segment_file::magic) - 1 + sizeof(segment_file::version) + sizeof(segment_file::byte_order_mark);
+
+// Each encoded segment needs at least four varints of at least one byte.
+const std::size_t min_encoded_segment_size = 4;
+
+int open_for_reading(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY); // NOLINT(hicpp-signed-bitwise)
+    if (fd == -1) {
+        throw std::system_error{errno, std::system_category(), std::string{"Opening segment file '"} + filename + "' failed"};
+    }
+    return fd;
+}
+
+std::size_t file_size(int fd, const std::string& filename) {
+    struct stat s; // NOLINT(cppcoreguidelines-pro-type-member-init, hicpp-member-init)
+    if (::fstat(fd, &s) != 0) {
+        throw std::system_error{errno, std::system_category(), std::string{"Can't get file size for '"} + filename + "'"};
+    }
+    return static_cast<std::size_t>(s.st_size);
+}
+
+void add_delta(std::string* data, int64_t delta) {
+    protozero::add_varint_to_buffer(data, protozero::encode_zigzag64(delta));
+}
+
+int32_t get_delta(const char** data, const char* end, int64_t base) {
+    return static_cast<int32_t>(base + protozero::decode_zigzag64(protozero::decode_varint(data, end)));
+}
+
+/**
+ * Almost every location is the first location of one segment and the
+ * second location of another. In the sorted segments the one with the
+ * location as second location comes first. So the encoder and decoder
+ * both remember the second locations of the segments and the first
+ * location is usually encoded as a reference to one of them.
+ */
+class second_locations {
+
+    // Map from x to the y coordinates of second locations, in the order
+    // they were added.
+    std::multimap<int32_t, int32_t> m_locations;
+
+public:
+
+    /**
+     * Forget locations with x smaller than the specified one. They can
+     * not be referenced any more, because the segments are sorted by the
+     * x coordinate of their first location.
+     */
+    void remove_before(int32_t x) {
+        m_locations.erase(m_locations.begin(), m_locations.lower_bound(x));
+    }
+
+    void add(const osmium::Location& location) {
+        m_locations.emplace(location.x(), location.y());
+    }
+
+    /**
+     * Find the location and return its position (starting from 1) among
+     * those with the same x coordinate. Returns 0 if it isn't there. The
+     * location is removed.
+     */
+    uint64_t find(const osmium::Location& location) {
+        uint64_t pos = 1;
+        const auto range = m_locations.equal_range(location.x());
+        for (auto it = range.first; it != range.second; ++it, ++pos) {
+            if (it->second == location.y()) {
+                m_locations.erase(it);
+                return pos;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Get the y coordinate of the location with the x coordinate at the
+     * position returned from find(). The location is removed.
+     */
+    int32_t get(int32_t x, uint64_t pos) {
+        const auto range = m_locations.equal_range(x);
+        auto it = range.first;
+        for (; it != range.second && pos > 1; ++it, --pos) {
+        }
+        if (it == range.second) {
+            throw std::runtime_error{"invalid location reference"};
+        }
+        const int32_t y = it->second;
+        m_locations.erase(it);
+        return y;
+    }
+
+}; // class second_locations
+
+/**
+ * Encode the segments of one block: For each segment the x coordinate of
+ * the first location relative to that of the previous segment, then
+ * either a reference to an earlier second location or 0 followed by the y
+ * coordinate relative to that of the previous segment. Then the second
+ * location relative to the first location. All numbers are varints,
+ * differences are zigzag encoded.
+ */
+std::string encode_block(const osmium::UndirectedSegment* segments, std::size_t count) {
+    std::string data;
+    data.reserve(count * 6);
+
+    second_locations seconds;
+    int64_t x = 0;
+    int64_t y = 0;
+    for (std::size_t n = 0; n < count; ++n) {
+        const auto& first = segments[n].first();
+        const auto& second = segments[n].second();
+
+        add_delta(&data, first.x() - x);
+        seconds.remove_before(first.x());
+        const uint64_t pos = seconds.find(first);
+        protozero::add_varint_to_buffer(&data, pos);
+        if (pos == 0) {
+            add_delta(&data, first.y() - y);
+        }
+        add_delta(&data, static_cast<int64_t>(second.x()) - first.x());
+        add_delta(&data, static_cast<int64_t>(second.y()) - first.y());
+
+        seconds.add(second);
+        x = first.x();
+        y = first.y();
+    }
+
+    return data;
+}
+
+std::string compress(const std::string& input) {
+    uLongf size = ::compressBound(static_cast<uLong>(input.size()));
+    std::string output(size, '\0');
+    if (::compress2(reinterpret_cast<Bytef*>(&output[0]), &size, // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+                    reinterpret_cast<const Bytef*>(input.data()), // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+                    static_cast<uLong>(input.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+        throw std::runtime_error{"Compressing segment block failed"};
+    }
+    output.resize(size);
+    return output;
+}
+
+} // anonymous namespace
+
+SegmentFileWriter::SegmentFileWriter(const std::string& filename) :
+    m_filename(filename),
+    m_fd(::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)) { // NOLINT(hicpp-signed-bitwise)
+    if (m_fd == -1) {
+        throw std::system_error{errno, std::system_category(), std::string{"Opening segment file '"} + filename + "' failed"};
+    }
+    m_segments.reserve(segment_file::block_size);
+
+    write(segment_file::magic, sizeof(segment_file::magic) - 1);
+    write(&segment_file::version, sizeof(segment_file::version));
+    write(&segment_file::byte_order_mark, sizeof(segment_file::byte_order_mark));
+}
+
+SegmentFileWriter::~SegmentFileWriter() noexcept {
+    // The tasks in the thread pool own their segments and don't reference
+    // this object. We still wait for them, so that no work for a file that
+    // is not written any more is left in the pool.
+    for (const auto& future : m_queue) {
+        if (future.valid()) {
+            future.wait();
+        }
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+}
+
+void SegmentFileWriter::write(const void* data, std::size_t size) {
+    const char* ptr = static_cast<const char*>(data);
+    while (size > 0) {
+#ifndef _MSC_VER
+        const auto nwritten = ::write(m_fd, ptr, size);
+#else
+        const auto nwritten = _write(m_fd, ptr, static_cast<unsigned int>(size));
+#endif
+        if (nwritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error{errno, std::system_category(), std::string{"Write error on '"} + m_filename + "'"};
+        }
+        ptr += nwritten;
+        size -= static_cast<std::size_t>(nwritten);
+        m_offset += static_cast<uint64_t>(nwritten);
+    }
+}
+
+/**
+ * Encode and compress the segments collected so far in the thread pool.
+ * The index entry is created now, the offset and sizes are filled in when
+ * the block is written.
+ */
+void SegmentFileWriter::submit_block() {
+    m_blocks.push_back(segment_file::block_info{0, 0, 0, m_segments.size(), m_segments.front(), m_segments.back()});
+
+    m_queue.push_back(osmium::thread::Pool::default_instance().submit([segments = std::move(m_segments)]() {
+        std::string data = encode_block(segments.data(), segments.size());
+        const auto raw_size = static_cast<uint32_t>(data.size());
+        return encoded_block{compress(data), raw_size};
+    }));
+
+    m_segments.clear();
+    m_segments.reserve(segment_file::block_size);
+}
+
+/// Write out the oldest block in the queue.
+void SegmentFileWriter::write_block() {
+    const encoded_block block = m_queue.front().get();
+    m_queue.pop_front();
+
+    auto& info = m_blocks[m_blocks.size() - m_queue.size() - 1];
+    info.offset = m_offset;
+    info.size = static_cast<uint32_t>(block.data.size());
+    info.raw_size = block.raw_size;
+
+    write(block.data.data(), block.data.size());
+}
+
+void SegmentFileWriter::add(const std::vector<osmium::UndirectedSegment>& segments) {
+    for (const auto& segment : segments) {
+        m_segments.push_back(segment);
+        if (m_segments.size() == segment_file::block_size) {
+            submit_block();
+            if (m_queue.size() > max_queue_size) {
+                write_block();
+            }
+        }
+    }
+}
+
+void SegmentFileWriter::close() {
+    if (!m_segments.empty()) {
+        submit_block();
+    }
+    while (!m_queue.empty()) {
+        write_block();
+    }
+
+    const segment_file::footer footer{m_offset, m_blocks.size()};
+    write(m_blocks.data(), m_blocks.size() * sizeof(segment_file::block_info));
+    write(&footer, sizeof(footer));
+
+    const int fd = m_fd;
+    m_fd = -1;
+    if (::close(fd) != 0) {
+        throw std::system_error{errno, std::system_category(), std::string{"Closing '"} + m_filename + "' failed"};
+    }
+}
+
+SegmentFileReader::SegmentFileReader(const std::string& filename) :
+    m_filename(filename),
+    m_fd(open_for_reading(filename)),
+    m_file_size(file_size(m_fd.get(), filename)) {
+    if (m_file_size > 0) {
+        m_mapping = std::make_unique<osmium::util::MemoryMapping>(m_file_size, osmium::util::MemoryMapping::mapping_mode::readonly, m_fd.get());
+    }
+
+    if (m_file_size >= header_size && std::memcmp(data(), segment_file::magic, sizeof(segment_file::magic) - 1) == 0) {
+        read_index();
+    } else {
+        make_raw_index();
+    }
+}
+
+void SegmentFileReader::read_index() {
+    const char* ptr = data() + sizeof(segment_file::magic) - 1;
+
+    uint32_t version = 0;
+    std::memcpy(&version, ptr, sizeof(version));
+    if (version != segment_file::version) {
+        throw std::runtime_error{"Segment file '" + m_filename + "' has unsupported version"};
+    }
+    ptr += sizeof(version);
+
+    uint32_t byte_order_mark = 0;
+    std::memcpy(&byte_order_mark, ptr, sizeof(byte_order_mark));
+    if (byte_order_mark != segment_file::byte_order_mark) {
+        throw std::runtime_error{"Segment file '" + m_filename + "' was written on a machine with different byte order"};
+    }
+
+    if (m_file_size < header_size + sizeof(segment_file::footer)) {
+        throw std::runtime_error{"Segment file '" + m_filename + "' is truncated"};
+    }
+
+    segment_file::footer footer{0, 0};
+    std::memcpy(&footer, data() + m_file_size - sizeof(footer), sizeof(footer));
+    // The numbers in the footer can't be trusted, so all checks are written
+    // in a way that can't overflow.
+    const auto index_end = m_file_size - sizeof(footer);
+    if (footer.index_offset < header_size ||
+        footer.index_offset > index_end ||
+        footer.num_blocks > (index_end - footer.index_offset) / sizeof(segment_file::block_info) ||
+        footer.num_blocks * sizeof(segment_file::block_info) != index_end - footer.index_offset) {
+        throw std::runtime_error{"Segment file '" + m_filename + "' is truncated or corrupted"};
+    }
+
+    m_blocks.resize(footer.num_blocks, segment_file::block_info{0, 0, 0, 0, osmium::UndirectedSegment{osmium::Location{}, osmium::Location{}}, osmium::UndirectedSegment{osmium::Location{}, osmium::Location{}}});
+    std::memcpy(m_blocks.data(), data() + footer.index_offset, m_blocks.size() * sizeof(segment_file::block_info));
+
+    // The count is checked against the decoded size of the block, so that
+    // read_block() doesn't reserve huge amounts of memory.
+    for (const auto& block : m_blocks) {
+        if (block.offset < header_size ||
+            block.offset > footer.index_offset ||
+            block.size > footer.index_offset - block.offset ||
+            block.count > segment_file::block_size ||
+            block.count > block.raw_size / min_encoded_segment_size) {
+            throw std::runtime_error{"Segment file '" + m_filename + "' is corrupted"};
+        }
+        m_num_segments += block.count;
+    }
+}
+
+void SegmentFileReader::make_raw_index() {
+    if (m_file_size % sizeof(osmium::UndirectedSegment) != 0) {
+        throw std::runtime_error{"File '" + m_filename + "' is not a segment file"};
+    }
+
+    m_raw = true;
+    m_num_segments = m_file_size / sizeof(osmium::UndirectedSegment);
+    if (m_num_segments == 0) {
+        return;
+    }
+
+    const auto* segments = reinterpret_cast<const osmium::UndirectedSegment*>(data()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    for (std::size_t begin = 0; begin < m_num_segments; begin += segment_file::block_size) {
+        const std::size_t count = std::min(segment_file::block_size, m_num_segments - begin);
+        m_blocks.push_back(segment_file::block_info{begin * sizeof(osmium::UndirectedSegment),
+                                                    static_cast<uint32_t>(count * sizeof(osmium::UndirectedSegment)),
+                                                    static_cast<uint32_t>(count * sizeof(osmium::UndirectedSegment)),
+                                                    count,
+                                                    segments[begin],
+                                                    segments[begin + count - 1]});
+    }
+}
+
+void SegmentFileReader::read_block(std::size_t n, std::vector<osmium::UndirectedSegment>* segments) const {
+    const auto& block = m_blocks[n];
+
+    if (m_raw) {
+        const auto* begin = reinterpret_cast<const osmium::UndirectedSegment*>(data() + block.offset); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        segments->insert(segments->end(), begin, begin + block.count);
+        return;
+    }
+
+    std::string raw(block.raw_size, '\0');
+    uLongf raw_size = block.raw_size;
+    if (::uncompress(reinterpret_cast<Bytef*>(&raw[0]), &raw_size, // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+                     reinterpret_cast<const Bytef*>(data() + block.offset), block.size) != Z_OK || // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+        raw_size != block.raw_size) {
+        throw std::runtime_error{"Segment file '" + m_filename + "' has corrupted block"};
+    }
+
+    const char* ptr = raw.data();
+    const char* end = ptr + raw.size();
+    segments->reserve(segments->size() + block.count);
+    second_locations seconds;
+    int64_t x = 0;
+    int64_t y = 0;
+    try {
+        for (uint64_t i = 0; i < block.count; ++i) {
+            const int32_t x1 = get_delta(&ptr, end, x);
+            seconds.remove_before(x1);
+            const uint64_t pos = protozero::decode_varint(&ptr, end);
+            const int32_t y1 = pos == 0 ? get_delta(&ptr, end, y) : seconds.get(x1, pos);
+            const int32_t x2 = get_delta(&ptr, end, x1);
+            const int32_t y2 = get_delta(&ptr, end, y1);
+            segments->emplace_back(osmium::Location{x1, y1}, osmium::Location{x2, y2});
+            seconds.add(segments->back().second());
+            x = x1;
+            y = y1;
+        }
+    } catch (const std::exception&) {
+        throw std::runtime_error{"Segment file '" + m_filename + "' has corrupted block"};
+    }
+}
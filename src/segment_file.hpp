@@ -0,0 +1,211 @@
+#ifndef SEGMENT_FILE_HPP
+#define SEGMENT_FILE_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "file_descriptor.hpp"
+
+#include <osmium/osm/undirected_segment.hpp>
+#include <osmium/util/memory_mapping.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Segment files contain the sorted coastline segments written with the
+ * --write-segments option of osmcoastline.
+ *
+ * After a header (magic, version and byte order mark) the file contains
+ * blocks of up to segment_file::block_size segments. Each block is
+ * compressed on its own with zlib. Inside the block the coordinates are
+ * delta encoded as varints, most first locations are encoded as references
+ * to the second location of an earlier segment in the block (see
+ * encode_block() for details).
+ *
+ * After the blocks comes the block index with a segment_file::block_info
+ * for each block and then a footer with the offset of the index and the
+ * number of blocks.
+ *
+ * Like snapshot files, segment files are written in the native byte order.
+ *
+ * Older versions of osmcoastline wrote the segments without any header
+ * or compression. Those files can still be read.
+ */
+namespace segment_file {
+
+    constexpr const char magic[] = "OSMCSEGS"; // NOLINT(cppcoreguidelines-avoid-c-arrays, hicpp-avoid-c-arrays, modernize-avoid-c-arrays)
+    constexpr const uint32_t version = 1;
+    constexpr const uint32_t byte_order_mark = 0x01020304U;
+
+    /// Maximum number of segments in a block.
+    constexpr const std::size_t block_size = 64UL * 1024UL;
+
+    /// Entry in the block index.
+    struct block_info {
+
+        /// Offset of the compressed block data in the file.
+        uint64_t offset;
+
+        /// Size of the compressed block data.
+        uint32_t size;
+
+        /// Size of the block data before compression.
+        uint32_t raw_size;
+
+        /// Number of segments in the block.
+        uint64_t count;
+
+        /// The first (smallest) segment in the block.
+        osmium::UndirectedSegment min;
+
+        /// The last (largest) segment in the block.
+        osmium::UndirectedSegment max;
+
+    }; // struct block_info
+
+    struct footer {
+        uint64_t index_offset;
+        uint64_t num_blocks;
+    };
+
+} // namespace segment_file
+
+/**
+ * Writes a segment file. The segments must be added in sorted order. The
+ * blocks are compressed in the thread pool of libosmium.
+ */
+class SegmentFileWriter {
+
+    struct encoded_block {
+        std::string data;
+        uint32_t raw_size;
+    };
+
+    std::string m_filename;
+    int m_fd;
+    std::vector<osmium::UndirectedSegment> m_segments;
+    std::deque<std::future<encoded_block>> m_queue;
+    std::vector<segment_file::block_info> m_blocks;
+    uint64_t m_offset = 0;
+
+    void write(const void* data, std::size_t size);
+    void submit_block();
+    void write_block();
+
+public:
+
+    /// Create the segment file and write the header.
+    explicit SegmentFileWriter(const std::string& filename);
+
+    SegmentFileWriter(const SegmentFileWriter&) = delete;
+    SegmentFileWriter& operator=(const SegmentFileWriter&) = delete;
+
+    SegmentFileWriter(SegmentFileWriter&&) = delete;
+    SegmentFileWriter& operator=(SegmentFileWriter&&) = delete;
+
+    ~SegmentFileWriter() noexcept;
+
+    /// Add segments. They must be sorted and come after all earlier ones.
+    void add(const std::vector<osmium::UndirectedSegment>& segments);
+
+    /**
+     * Write out the remaining blocks, the index and the footer and close
+     * the file. Throws on write errors.
+     */
+    void close();
+
+    const std::string& filename() const noexcept {
+        return m_filename;
+    }
+
+}; // class SegmentFileWriter
+
+/**
+ * Reads a segment file in the current format or in the old raw format.
+ * The file is memory mapped and blocks can be read independently of each
+ * other. For raw files the blocks are consecutive ranges of block_size
+ * segments.
+ */
+class SegmentFileReader {
+
+    std::string m_filename;
+    FileDescriptor m_fd;
+    std::size_t m_file_size;
+    std::unique_ptr<osmium::util::MemoryMapping> m_mapping;
+    std::vector<segment_file::block_info> m_blocks;
+    std::size_t m_num_segments = 0;
+    bool m_raw = false;
+
+    const char* data() const noexcept {
+        return m_mapping->get_addr<char>();
+    }
+
+    void read_index();
+    void make_raw_index();
+
+public:
+
+    /// Open and map the segment file and read the block index.
+    explicit SegmentFileReader(const std::string& filename);
+
+    SegmentFileReader(const SegmentFileReader&) = delete;
+    SegmentFileReader& operator=(const SegmentFileReader&) = delete;
+
+    SegmentFileReader(SegmentFileReader&&) = delete;
+    SegmentFileReader& operator=(SegmentFileReader&&) = delete;
+
+    ~SegmentFileReader() noexcept = default;
+
+    /// Is this a file in the old format without header and compression?
+    bool is_raw() const noexcept {
+        return m_raw;
+    }
+
+    /// Total number of segments in the file.
+    std::size_t num_segments() const noexcept {
+        return m_num_segments;
+    }
+
+    /// The index with information about all blocks.
+    const std::vector<segment_file::block_info>& blocks() const noexcept {
+        return m_blocks;
+    }
+
+    /**
+     * Read the block with the specified number. The segments are appended
+     * to the vector. This function can be called from several threads at
+     * the same time.
+     */
+    void read_block(std::size_t n, std::vector<osmium::UndirectedSegment>* segments) const;
+
+    const std::string& filename() const noexcept {
+        return m_filename;
+    }
+
+}; // class SegmentFileReader
+
+#endif // SEGMENT_FILE_HPP
@@ -0,0 +1,256 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_intersection.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define OSMCOASTLINE_AVX2_KERNEL
+# include <immintrin.h>
+#endif
+
+/*
+ * The orientation tests below calculate the sign of a cross product of
+ * two coordinate differences: dx1 * dy2 - dy1 * dx2. The x coordinates
+ * of valid locations are between -1.8e9 and 1.8e9, y coordinates between
+ * -0.9e9 and 0.9e9. So differences of x coordinates fit into 33 bits,
+ * differences of y coordinates into 32 bits (signed) and each product fits
+ * into an int64_t. Instead of subtracting the products (which could
+ * overflow) they are compared.
+ */
+
+namespace {
+
+// Set by disable_avx2_intersections().
+bool avx2_disabled = false;
+
+/// Sign of a * b - c * d.
+int compare_products(int64_t a, int64_t b, int64_t c, int64_t d) noexcept {
+    const int64_t p = a * b;
+    const int64_t q = c * d;
+    return static_cast<int>(p > q) - static_cast<int>(p < q);
+}
+
+/// Which side of the line from a to b is c on? (Sign of the cross product.)
+int orientation(const osmium::Location& a, const osmium::Location& b, const osmium::Location& c) noexcept {
+    return compare_products(static_cast<int64_t>(b.x()) - a.x(), static_cast<int64_t>(c.y()) - a.y(),
+                            static_cast<int64_t>(b.y()) - a.y(), static_cast<int64_t>(c.x()) - a.x());
+}
+
+void segments_intersect_scalar(const osmium::Segment& segment, const SegmentBatch& batch, std::size_t begin, std::vector<uint8_t>* results) {
+    for (std::size_t n = begin; n < batch.size(); ++n) {
+        const osmium::Segment other{osmium::Location{batch.x1()[n], batch.y1()[n]},
+                                    osmium::Location{batch.x2()[n], batch.y2()[n]}};
+        (*results)[n] = segments_intersect(other, segment) ? 1 : 0;
+    }
+}
+
+#ifdef OSMCOASTLINE_AVX2_KERNEL
+
+bool cpu_has_avx2() noexcept {
+    static const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+    return avx2;
+}
+
+__attribute__((target("avx2")))
+__m256i load_4(const int32_t* data) noexcept {
+    return _mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+/// Mask with all lanes set where the value doesn't fit into an int32_t.
+__attribute__((target("avx2")))
+__m256i outside_int32(__m256i value) noexcept {
+    const __m256i max = _mm256_set1_epi64x(std::numeric_limits<int32_t>::max());
+    const __m256i min = _mm256_set1_epi64x(std::numeric_limits<int32_t>::min());
+    return _mm256_or_si256(_mm256_cmpgt_epi64(value, max), _mm256_cmpgt_epi64(min, value));
+}
+
+/// Mask with all lanes set where a * b and c * d have the same non-zero sign as e * f - g * h.
+__attribute__((target("avx2")))
+__m256i same_side(__m256i a, __m256i b, __m256i c, __m256i d,
+                  __m256i e, __m256i f, __m256i g, __m256i h) noexcept {
+    const __m256i p1 = _mm256_mul_epi32(a, b);
+    const __m256i q1 = _mm256_mul_epi32(c, d);
+    const __m256i p2 = _mm256_mul_epi32(e, f);
+    const __m256i q2 = _mm256_mul_epi32(g, h);
+    const __m256i both_left = _mm256_and_si256(_mm256_cmpgt_epi64(p1, q1), _mm256_cmpgt_epi64(p2, q2));
+    const __m256i both_right = _mm256_and_si256(_mm256_cmpgt_epi64(q1, p1), _mm256_cmpgt_epi64(q2, p2));
+    return _mm256_or_si256(both_left, both_right);
+}
+
+/// Mask with all lanes set where the points are the same.
+__attribute__((target("avx2")))
+__m256i same_point(__m256i ax, __m256i ay, __m256i bx, __m256i by) noexcept {
+    return _mm256_and_si256(_mm256_cmpeq_epi64(ax, bx), _mm256_cmpeq_epi64(ay, by));
+}
+
+/**
+ * Same as segments_intersect_scalar(), but tests four segments at a time
+ * using the AVX2 32x32->64 bit multiplication. This needs all differences
+ * of x coordinates to fit into 32 bits, if they don't (segments longer
+ * than about 214 degrees) the scalar code is used.
+ */
+__attribute__((target("avx2")))
+void segments_intersect_avx2(const osmium::Segment& segment, const SegmentBatch& batch, std::vector<uint8_t>* results) {
+    const int64_t dqx_scalar = static_cast<int64_t>(segment.second().x()) - segment.first().x();
+    if (dqx_scalar > std::numeric_limits<int32_t>::max() || dqx_scalar < std::numeric_limits<int32_t>::min()) {
+        segments_intersect_scalar(segment, batch, 0, results);
+        return;
+    }
+
+    const __m256i qx1 = _mm256_set1_epi64x(segment.first().x());
+    const __m256i qy1 = _mm256_set1_epi64x(segment.first().y());
+    const __m256i qx2 = _mm256_set1_epi64x(segment.second().x());
+    const __m256i qy2 = _mm256_set1_epi64x(segment.second().y());
+    const __m256i dqx = _mm256_sub_epi64(qx2, qx1);
+    const __m256i dqy = _mm256_sub_epi64(qy2, qy1);
+
+    std::size_t n = 0;
+    for (; n + 4 <= batch.size(); n += 4) {
+        const __m256i cx1 = load_4(batch.x1() + n);
+        const __m256i cy1 = load_4(batch.y1() + n);
+        const __m256i cx2 = load_4(batch.x2() + n);
+        const __m256i cy2 = load_4(batch.y2() + n);
+
+        const __m256i dcx = _mm256_sub_epi64(cx2, cx1); // c2 - c1
+        const __m256i dcy = _mm256_sub_epi64(cy2, cy1);
+        const __m256i a1x = _mm256_sub_epi64(qx1, cx1); // q1 - c1
+        const __m256i a1y = _mm256_sub_epi64(qy1, cy1);
+        const __m256i a2x = _mm256_sub_epi64(qx2, cx1); // q2 - c1
+        const __m256i a2y = _mm256_sub_epi64(qy2, cy1);
+        const __m256i b2x = _mm256_sub_epi64(cx2, qx1); // c2 - q1
+        const __m256i b2y = _mm256_sub_epi64(cy2, qy1);
+
+        const __m256i too_long = _mm256_or_si256(_mm256_or_si256(outside_int32(dcx), outside_int32(a1x)),
+                                                 _mm256_or_si256(outside_int32(a2x), outside_int32(b2x)));
+        if (!_mm256_testz_si256(too_long, too_long)) {
+            for (std::size_t k = n; k < n + 4; ++k) {
+                const osmium::Segment other{osmium::Location{batch.x1()[k], batch.y1()[k]},
+                                            osmium::Location{batch.x2()[k], batch.y2()[k]}};
+                (*results)[k] = segments_intersect(other, segment) ? 1 : 0;
+            }
+            continue;
+        }
+
+        // q1 and q2 on the same side of c?
+        const __m256i same_side_q = same_side(dcx, a1y, dcy, a1x, dcx, a2y, dcy, a2x);
+
+        // c1 and c2 on the same side of q? (c1 - q1 = -a1)
+        const __m256i same_side_c = same_side(dqy, a1x, dqx, a1y, dqx, b2y, dqy, b2x);
+
+        const __m256i parallel = _mm256_cmpeq_epi64(_mm256_mul_epi32(dcx, dqy), _mm256_mul_epi32(dcy, dqx));
+
+        const __m256i shared_point = _mm256_or_si256(_mm256_or_si256(same_point(cx1, cy1, qx1, qy1), same_point(cx1, cy1, qx2, qy2)),
+                                                     _mm256_or_si256(same_point(cx2, cy2, qx1, qy1), same_point(cx2, cy2, qx2, qy2)));
+
+        const __m256i no_intersection = _mm256_or_si256(_mm256_or_si256(same_side_q, same_side_c),
+                                                        _mm256_or_si256(parallel, shared_point));
+
+        const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(no_intersection));
+        for (std::size_t k = 0; k < 4; ++k) {
+            (*results)[n + k] = ((static_cast<unsigned int>(mask) >> k) & 1U) ? 0 : 1;
+        }
+    }
+
+    segments_intersect_scalar(segment, batch, n, results);
+}
+
+#endif
+
+} // anonymous namespace
+
+bool segments_intersect(const osmium::Segment& s1, const osmium::Segment& s2) noexcept {
+    if (s1.first()  == s2.first()  ||
+        s1.first()  == s2.second() ||
+        s1.second() == s2.first()  ||
+        s1.second() == s2.second()) {
+        return false;
+    }
+
+    // Parallel or collinear segments (this includes segments of length 0)
+    if (compare_products(static_cast<int64_t>(s1.second().x()) - s1.first().x(), static_cast<int64_t>(s2.second().y()) - s2.first().y(),
+                         static_cast<int64_t>(s1.second().y()) - s1.first().y(), static_cast<int64_t>(s2.second().x()) - s2.first().x()) == 0) {
+        return false;
+    }
+
+    return orientation(s1.first(), s1.second(), s2.first()) * orientation(s1.first(), s1.second(), s2.second()) <= 0 &&
+           orientation(s2.first(), s2.second(), s1.first()) * orientation(s2.first(), s2.second(), s1.second()) <= 0;
+}
+
+void segments_intersect(const osmium::Segment& segment, const SegmentBatch& batch, std::vector<uint8_t>* results) {
+    results->resize(batch.size());
+#ifdef OSMCOASTLINE_AVX2_KERNEL
+    if (!avx2_disabled && cpu_has_avx2()) {
+        segments_intersect_avx2(segment, batch, results);
+        return;
+    }
+#endif
+    segments_intersect_scalar(segment, batch, 0, results);
+}
+
+void disable_avx2_intersections() noexcept {
+    avx2_disabled = true;
+}
+
+bool segments_overlap(const osmium::Segment& s1, const osmium::Segment& s2) noexcept {
+    if (s1.first() == s1.second() || s2.first() == s2.second()) {
+        return false;
+    }
+
+    if (orientation(s1.first(), s1.second(), s2.first()) != 0 ||
+        orientation(s1.first(), s1.second(), s2.second()) != 0) {
+        return false;
+    }
+
+    // The segments are on the same line, compare the ranges they cover
+    // on the x axis or, for vertical lines, on the y axis.
+    const bool vertical = s1.first().x() == s1.second().x();
+    const auto coordinate = [vertical](const osmium::Location& location) noexcept {
+        return vertical ? location.y() : location.x();
+    };
+
+    const int32_t min1 = std::min(coordinate(s1.first()), coordinate(s1.second()));
+    const int32_t max1 = std::max(coordinate(s1.first()), coordinate(s1.second()));
+    const int32_t min2 = std::min(coordinate(s2.first()), coordinate(s2.second()));
+    const int32_t max2 = std::max(coordinate(s2.first()), coordinate(s2.second()));
+
+    return std::max(min1, min2) < std::min(max1, max2);
+}
+
+osmium::Location intersection_location(const osmium::Segment& s1, const osmium::Segment& s2) {
+    const double denom = ((s2.second().lat() - s2.first().lat())*(s1.second().lon() - s1.first().lon())) -
+                         ((s2.second().lon() - s2.first().lon())*(s1.second().lat() - s1.first().lat()));
+
+    const double nume_a = ((s2.second().lon() - s2.first().lon())*(s1.first().lat() - s2.first().lat())) -
+                          ((s2.second().lat() - s2.first().lat())*(s1.first().lon() - s2.first().lon()));
+
+    // The segments are known to intersect, but rounding errors can put the
+    // point slightly outside in nearly degenerate cases.
+    const double ua = denom == 0 ? 0.0 : std::min(1.0, std::max(0.0, nume_a / denom));
+    const double ix = s1.first().lon() + (ua * (s1.second().lon() - s1.first().lon()));
+    const double iy = s1.first().lat() + (ua * (s1.second().lat() - s1.first().lat()));
+    return {ix, iy};
+}
@@ -0,0 +1,124 @@
+#ifndef SEGMENT_INTERSECTION_HPP
+#define SEGMENT_INTERSECTION_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Coordinates of a batch of segments in structure-of-arrays layout. Used
+ * to test one segment against many others at once.
+ */
+class SegmentBatch {
+
+    std::vector<int32_t> m_x1;
+    std::vector<int32_t> m_y1;
+    std::vector<int32_t> m_x2;
+    std::vector<int32_t> m_y2;
+
+public:
+
+    SegmentBatch() = default;
+
+    std::size_t size() const noexcept {
+        return m_x1.size();
+    }
+
+    bool empty() const noexcept {
+        return m_x1.empty();
+    }
+
+    void clear() noexcept {
+        m_x1.clear();
+        m_y1.clear();
+        m_x2.clear();
+        m_y2.clear();
+    }
+
+    void push_back(const osmium::Segment& segment) {
+        m_x1.push_back(segment.first().x());
+        m_y1.push_back(segment.first().y());
+        m_x2.push_back(segment.second().x());
+        m_y2.push_back(segment.second().y());
+    }
+
+    const int32_t* x1() const noexcept {
+        return m_x1.data();
+    }
+
+    const int32_t* y1() const noexcept {
+        return m_y1.data();
+    }
+
+    const int32_t* x2() const noexcept {
+        return m_x2.data();
+    }
+
+    const int32_t* y2() const noexcept {
+        return m_y2.data();
+    }
+
+}; // class SegmentBatch
+
+/**
+ * Do the segments intersect? Segments sharing an end point, parallel and
+ * collinear segments never intersect, segments touching each other
+ * otherwise do. This uses exact integer arithmetic on the fixed-point
+ * coordinates.
+ */
+bool segments_intersect(const osmium::Segment& s1, const osmium::Segment& s2) noexcept;
+
+/**
+ * Test the segment against all segments in the batch. Sets results[n] to
+ * 1 if segments_intersect() is true for the segment and the nth segment of
+ * the batch and to 0 otherwise. Uses AVX2 instructions if the CPU has
+ * them.
+ */
+void segments_intersect(const osmium::Segment& segment, const SegmentBatch& batch, std::vector<uint8_t>* results);
+
+/**
+ * Don't use the AVX2 instructions in segments_intersect() for batches,
+ * even if the CPU has them. Only used for comparing the results with and
+ * without them in tests. Call this before any segments are tested.
+ */
+void disable_avx2_intersections() noexcept;
+
+/**
+ * Do the segments overlap in more than one point? This can only happen
+ * for collinear segments, so segments_intersect() is never true for
+ * them. Segments of length 0 never overlap anything. This uses exact
+ * integer arithmetic on the fixed-point coordinates.
+ */
+bool segments_overlap(const osmium::Segment& s1, const osmium::Segment& s2) noexcept;
+
+/**
+ * Calculate intersection point of two segments. Only call this if
+ * segments_intersect() returned true for them.
+ */
+osmium::Location intersection_location(const osmium::Segment& s1, const osmium::Segment& s2);
+
+#endif // SEGMENT_INTERSECTION_HPP
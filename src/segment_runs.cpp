@@ -0,0 +1,169 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_runs.hpp"
+#include "segment_sort.hpp"
+#include "temp_file.hpp"
+
+#include <osmium/osm/location.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <queue>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Number of segments read from each run at a time when merging.
+const std::size_t read_buffer_size = 64UL * 1024UL;
+
+// Number of merged segments handed to the callback at a time.
+const std::size_t merge_chunk_size = 64UL * 1024UL;
+
+/**
+ * Reads the segments of one run in chunks.
+ */
+class run_reader {
+
+    std::FILE* m_file;
+    std::vector<osmium::UndirectedSegment> m_buffer;
+    std::size_t m_count = 0;
+    std::size_t m_pos = 0;
+
+    void fill() {
+        m_count = std::fread(m_buffer.data(), sizeof(osmium::UndirectedSegment), m_buffer.size(), m_file);
+        if (m_count < m_buffer.size() && std::ferror(m_file)) {
+            throw std::system_error{errno, std::system_category(), "Reading temporary segment file failed"};
+        }
+        m_pos = 0;
+    }
+
+public:
+
+    explicit run_reader(std::FILE* file) :
+        m_file(file),
+        m_buffer(read_buffer_size, osmium::UndirectedSegment{osmium::Location{}, osmium::Location{}}) {
+        std::rewind(m_file);
+        fill();
+    }
+
+    bool empty() const noexcept {
+        return m_pos == m_count;
+    }
+
+    const osmium::UndirectedSegment& front() const noexcept {
+        return m_buffer[m_pos];
+    }
+
+    void pop() {
+        ++m_pos;
+        if (m_pos == m_count) {
+            fill();
+        }
+    }
+
+}; // class run_reader
+
+} // anonymous namespace
+
+SegmentRuns::SegmentRuns(std::size_t max_segments, std::string temp_dir) :
+    m_temp_dir(std::move(temp_dir)),
+    m_max_segments(max_segments) {
+}
+
+SegmentRuns::~SegmentRuns() noexcept {
+    for (auto* file : m_runs) {
+        std::fclose(file);
+    }
+}
+
+void SegmentRuns::spill() {
+    sort_segments(m_segments);
+
+    std::FILE* file = create_temp_file(m_temp_dir);
+    m_runs.push_back(file);
+
+    if (std::fwrite(m_segments.data(), sizeof(osmium::UndirectedSegment), m_segments.size(), file) != m_segments.size() ||
+        std::fflush(file) != 0) {
+        throw std::system_error{errno, std::system_category(), "Writing temporary segment file failed"};
+    }
+
+    m_size += m_segments.size();
+    m_segments.clear();
+}
+
+void SegmentRuns::finish() {
+    if (m_runs.empty()) {
+        sort_segments(m_segments);
+        m_size = m_segments.size();
+        return;
+    }
+
+    if (!m_segments.empty()) {
+        spill();
+    }
+
+    // Give the memory back, it is not needed any more for merging.
+    std::vector<osmium::UndirectedSegment>{}.swap(m_segments);
+}
+
+void SegmentRuns::merge(const chunk_func_type& func) {
+    std::vector<run_reader> readers;
+    readers.reserve(m_runs.size());
+    for (auto* file : m_runs) {
+        readers.emplace_back(file);
+    }
+
+    // Min-heap of the indexes of the readers ordered by their next segment.
+    const auto greater = [&readers](std::size_t a, std::size_t b) noexcept {
+        return readers[b].front() < readers[a].front();
+    };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(greater)> heap{greater};
+    for (std::size_t n = 0; n < readers.size(); ++n) {
+        if (!readers[n].empty()) {
+            heap.push(n);
+        }
+    }
+
+    std::vector<osmium::UndirectedSegment> chunk;
+    chunk.reserve(merge_chunk_size);
+    while (!heap.empty()) {
+        const auto n = heap.top();
+        heap.pop();
+        chunk.push_back(readers[n].front());
+        readers[n].pop();
+        if (!readers[n].empty()) {
+            heap.push(n);
+        }
+        if (chunk.size() == merge_chunk_size) {
+            func(chunk);
+            chunk.clear();
+        }
+    }
+
+    if (!chunk.empty()) {
+        func(chunk);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef SEGMENT_RUNS_HPP
+#define SEGMENT_RUNS_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Collects segments for sorting with a limit on the number of segments
+ * kept in memory. Whenever there are more segments than the limit, they
+ * are sorted and written to a temporary file as a "run" in the given
+ * directory. The sorted runs
+ * are then merged with merge().
+ *
+ * If the limit is never reached, all segments stay in memory and are
+ * sorted there by finish().
+ */
+class SegmentRuns {
+
+    std::vector<osmium::UndirectedSegment> m_segments;
+    std::vector<std::FILE*> m_runs;
+    std::string m_temp_dir;
+    std::size_t m_max_segments;
+    std::size_t m_size = 0;
+
+    static constexpr const std::size_t min_capacity = 1024;
+
+    void spill();
+
+public:
+
+    /// The type of the callback for merge().
+    using chunk_func_type = std::function<void(const std::vector<osmium::UndirectedSegment>&)>;
+
+    /**
+     * Constructor. The max_segments parameter is the maximum number of
+     * segments kept in memory, 0 means no limit. Runs are written to
+     * temporary files in temp_dir.
+     */
+    SegmentRuns(std::size_t max_segments, std::string temp_dir);
+
+    SegmentRuns(const SegmentRuns&) = delete;
+    SegmentRuns& operator=(const SegmentRuns&) = delete;
+
+    SegmentRuns(SegmentRuns&&) = delete;
+    SegmentRuns& operator=(SegmentRuns&&) = delete;
+
+    ~SegmentRuns() noexcept;
+
+    /// The segments in memory.
+    const std::vector<osmium::UndirectedSegment>& segments() const noexcept {
+        return m_segments;
+    }
+
+    /**
+     * Add a segment. If this reaches the limit, the segments in memory
+     * are written to a run. With a limit the vector never grows beyond
+     * it.
+     */
+    void add(const osmium::UndirectedSegment& segment) {
+        if (m_max_segments > 0 && m_segments.size() == m_segments.capacity()) {
+            const std::size_t capacity = m_segments.capacity() < min_capacity ? min_capacity : m_segments.capacity() * 2;
+            m_segments.reserve(capacity < m_max_segments ? capacity : m_max_segments);
+        }
+        m_segments.push_back(segment);
+        if (m_max_segments > 0 && m_segments.size() >= m_max_segments) {
+            spill();
+        }
+    }
+
+    /**
+     * Sort the segments in memory if there are no runs or write them to
+     * the last run otherwise. Call after all segments are added.
+     */
+    void finish();
+
+    /// Were any segments written to temporary files?
+    bool spilled() const noexcept {
+        return !m_runs.empty();
+    }
+
+    /// The number of runs written to temporary files.
+    std::size_t num_runs() const noexcept {
+        return m_runs.size();
+    }
+
+    /// The total number of segments after finish() was called.
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+
+    /**
+     * Merge the sorted runs. The function is called with consecutive
+     * chunks of the segments in sorted order. Only call this after
+     * finish() and if spilled() returns true.
+     */
+    void merge(const chunk_func_type& func);
+
+}; // class SegmentRuns
+
+#endif // SEGMENT_RUNS_HPP
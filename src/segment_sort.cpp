@@ -0,0 +1,184 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "segment_sort.hpp"
+
+#include <osmium/thread/pool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Ranges with fewer segments than this are sorted with std::sort().
+const std::size_t min_radix_sort_size = 256;
+
+// Below this size everything is sorted in the calling thread.
+const std::size_t min_parallel_sort_size = 1UL << 16U;
+
+// When counting in parallel, the segments are split into at most one chunk
+// per thread, but each chunk has at least this many segments.
+const std::size_t min_segments_per_chunk = 1UL << 20U;
+
+using segment_iterator = std::vector<osmium::UndirectedSegment>::iterator;
+
+using histogram = std::array<std::size_t, 256>;
+
+/**
+ * Unsigned version of a coordinate with the same order as the signed
+ * coordinate.
+ */
+uint32_t to_unsigned(int32_t value) noexcept {
+    return static_cast<uint32_t>(value) ^ 0x80000000U;
+}
+
+/**
+ * Byte number n (0 is the most significant) of the 16 byte sort key of
+ * the segment: x and y of the first location, then x and y of the second
+ * location.
+ */
+unsigned int key_byte(const osmium::UndirectedSegment& segment, unsigned int n) noexcept {
+    const osmium::Location& location = n < 8 ? segment.first() : segment.second();
+    const int32_t coordinate = (n % 8) < 4 ? location.x() : location.y();
+    return (to_unsigned(coordinate) >> (24U - 8U * (n % 4))) & 0xffU;
+}
+
+histogram count_bytes(segment_iterator begin, segment_iterator end, unsigned int n) noexcept {
+    histogram counts{};
+    for (auto it = begin; it != end; ++it) {
+        ++counts[key_byte(*it, n)];
+    }
+    return counts;
+}
+
+/**
+ * Move the segments into their buckets in place (American flag sort).
+ * Returns the start of each bucket, with the end of the range appended.
+ */
+std::array<std::size_t, 257> distribute(segment_iterator begin, const histogram& counts, unsigned int n) noexcept {
+    std::array<std::size_t, 257> starts{};
+    for (std::size_t b = 0; b < counts.size(); ++b) {
+        starts[b + 1] = starts[b] + counts[b];
+    }
+
+    auto heads = starts;
+    for (unsigned int b = 0; b < 256; ++b) {
+        while (heads[b] < starts[b + 1]) {
+            osmium::UndirectedSegment segment = begin[heads[b]];
+            unsigned int kb = key_byte(segment, n);
+            while (kb != b) {
+                std::swap(segment, begin[heads[kb]++]);
+                kb = key_byte(segment, n);
+            }
+            begin[heads[b]++] = segment;
+        }
+    }
+
+    return starts;
+}
+
+void radix_sort(segment_iterator begin, segment_iterator end, unsigned int n) {
+    while (n < 16) {
+        const auto size = static_cast<std::size_t>(end - begin);
+        if (size < min_radix_sort_size) {
+            std::sort(begin, end);
+            return;
+        }
+
+        const histogram counts = count_bytes(begin, end, n);
+
+        // All segments have the same byte here, no need to move them.
+        if (std::find(counts.cbegin(), counts.cend(), size) != counts.cend()) {
+            ++n;
+            continue;
+        }
+
+        const auto starts = distribute(begin, counts, n);
+        for (std::size_t b = 0; b < counts.size(); ++b) {
+            if (counts[b] > 1) {
+                radix_sort(begin + starts[b], begin + starts[b + 1], n + 1);
+            }
+        }
+        return;
+    }
+}
+
+} // anonymous namespace
+
+void sort_segments(std::vector<osmium::UndirectedSegment>& segments) {
+    if (segments.size() < min_parallel_sort_size) {
+        radix_sort(segments.begin(), segments.end(), 0);
+        return;
+    }
+
+    auto& pool = osmium::thread::Pool::default_instance();
+
+    // Count the highest byte in parallel...
+    const auto num_chunks = std::max(std::min(static_cast<std::size_t>(pool.num_threads()),
+                                              segments.size() / min_segments_per_chunk),
+                                     static_cast<std::size_t>(1));
+    const auto chunk_size = (segments.size() + num_chunks - 1) / num_chunks;
+
+    std::vector<std::future<histogram>> count_futures;
+    count_futures.reserve(num_chunks);
+    for (std::size_t pos = 0; pos < segments.size(); pos += chunk_size) {
+        const auto begin = segments.begin() + pos;
+        const auto end = segments.begin() + std::min(pos + chunk_size, segments.size());
+        count_futures.push_back(pool.submit([begin, end]() {
+            return count_bytes(begin, end, 0);
+        }));
+    }
+
+    histogram counts{};
+    for (auto& future : count_futures) {
+        const auto chunk_counts = future.get();
+        for (std::size_t b = 0; b < counts.size(); ++b) {
+            counts[b] += chunk_counts[b];
+        }
+    }
+
+    // ...then distribute the segments on the buckets...
+    const auto starts = distribute(segments.begin(), counts, 0);
+
+    // ...and sort the buckets in parallel.
+    std::vector<std::future<void>> sort_futures;
+    for (std::size_t b = 0; b < counts.size(); ++b) {
+        if (counts[b] > 1) {
+            const auto begin = segments.begin() + starts[b];
+            const auto end = segments.begin() + starts[b + 1];
+            sort_futures.push_back(pool.submit([begin, end]() {
+                radix_sort(begin, end, 1);
+            }));
+        }
+    }
+
+    for (const auto& future : sort_futures) {
+        future.wait();
+    }
+    for (auto& future : sort_futures) {
+        future.get();
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef SEGMENT_SORT_HPP
+#define SEGMENT_SORT_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <osmium/osm/undirected_segment.hpp>
+
+#include <vector>
+
+/**
+ * Sort the segments into the same order as std::sort() with the
+ * operator< of osmium::UndirectedSegment would, ie. by the x and y
+ * coordinates of the first and then the second location.
+ *
+ * This is an in-place MSD radix sort on the 16 byte key formed by the
+ * four coordinates. The segments are distributed on the highest byte of
+ * the x coordinate of the first location, the resulting buckets are then
+ * sorted in parallel in the thread pool of libosmium. Small buckets are
+ * sorted with std::sort().
+ */
+void sort_segments(std::vector<osmium::UndirectedSegment>& segments);
+
+#endif // SEGMENT_SORT_HPP
@@ -0,0 +1,147 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "snapshot.hpp"
+
+#include <osmium/util/memory_mapping.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <system_error>
+
+#ifndef _MSC_VER
+# include <unistd.h>
+#else
+# include <io.h>
+#endif
+
+namespace {
+
+// Data is written out when the buffer gets larger than this.
+const std::size_t max_buffer_size = 1024UL * 1024UL;
+
+const std::size_t header_size = sizeof(snapshot::magic) - 1 + sizeof(snapshot::version) + sizeof(snapshot::byte_order_mark);
+
+int open_for_reading(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY); // NOLINT(hicpp-signed-bitwise)
+    if (fd == -1) {
+        throw std::system_error{errno, std::system_category(), std::string{"Opening snapshot file '"} + filename + "' failed"};
+    }
+    return fd;
+}
+
+std::size_t file_size(int fd, const std::string& filename) {
+    struct stat s; // NOLINT(cppcoreguidelines-pro-type-member-init, hicpp-member-init)
+    if (::fstat(fd, &s) != 0) {
+        throw std::system_error{errno, std::system_category(), std::string{"Can't get file size for '"} + filename + "'"};
+    }
+    if (static_cast<std::size_t>(s.st_size) < header_size) {
+        throw std::runtime_error{"File '" + filename + "' is not an osmcoastline snapshot file"};
+    }
+    return static_cast<std::size_t>(s.st_size);
+}
+
+} // anonymous namespace
+
+SnapshotWriter::SnapshotWriter(const std::string& filename) :
+    m_filename(filename),
+    m_fd(::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)) { // NOLINT(hicpp-signed-bitwise)
+    if (m_fd == -1) {
+        throw std::system_error{errno, std::system_category(), std::string{"Opening snapshot file '"} + filename + "' failed"};
+    }
+    m_buffer.reserve(max_buffer_size + 1024UL);
+
+    write(snapshot::magic, sizeof(snapshot::magic) - 1);
+    write(snapshot::version);
+    write(snapshot::byte_order_mark);
+}
+
+SnapshotWriter::~SnapshotWriter() noexcept {
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+}
+
+void SnapshotWriter::flush() {
+    const char* data = m_buffer.data();
+    std::size_t size = m_buffer.size();
+    while (size > 0) {
+#ifndef _MSC_VER
+        const auto nwritten = ::write(m_fd, data, size);
+#else
+        const auto nwritten = _write(m_fd, data, static_cast<unsigned int>(size));
+#endif
+        if (nwritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error{errno, std::system_category(), std::string{"Write error on '"} + m_filename + "'"};
+        }
+        data += nwritten;
+        size -= static_cast<std::size_t>(nwritten);
+    }
+    m_buffer.clear();
+}
+
+void SnapshotWriter::write(const void* data, std::size_t size) {
+    m_buffer.append(static_cast<const char*>(data), size);
+    if (m_buffer.size() > max_buffer_size) {
+        flush();
+    }
+}
+
+void SnapshotWriter::close() {
+    flush();
+    const int fd = m_fd;
+    m_fd = -1;
+    if (::close(fd) != 0) {
+        throw std::system_error{errno, std::system_category(), std::string{"Closing '"} + m_filename + "' failed"};
+    }
+}
+
+SnapshotReader::SnapshotReader(const std::string& filename) :
+    m_filename(filename),
+    m_fd(open_for_reading(filename)),
+    m_mapping(file_size(m_fd.get(), filename), osmium::util::MemoryMapping::mapping_mode::readonly, m_fd.get()) {
+    if (std::memcmp(read(sizeof(snapshot::magic) - 1), snapshot::magic, sizeof(snapshot::magic) - 1) != 0) {
+        throw std::runtime_error{"File '" + filename + "' is not an osmcoastline snapshot file"};
+    }
+    if (read<uint32_t>() != snapshot::version) {
+        throw std::runtime_error{"Snapshot file '" + filename + "' has unsupported version"};
+    }
+    if (read<uint32_t>() != snapshot::byte_order_mark) {
+        throw std::runtime_error{"Snapshot file '" + filename + "' was written on a machine with different byte order"};
+    }
+}
+
+const char* SnapshotReader::read(std::size_t size) {
+    if (size > m_mapping.size() - m_pos) {
+        throw std::runtime_error{"Snapshot file '" + m_filename + "' is truncated"};
+    }
+    const char* data = m_mapping.get_addr<char>() + m_pos;
+    m_pos += size;
+    return data;
+}
@@ -0,0 +1,146 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "file_descriptor.hpp"
+
+#include <osmium/util/memory_mapping.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/**
+ * Snapshot files contain the assembled coastline rings with all their node
+ * IDs and locations, so that later runs of osmcoastline don't need to read
+ * the OSM data again. See CoastlineRingCollection::write_snapshot() for
+ * the contents.
+ *
+ * Snapshot files are written in the native byte order and are not portable
+ * between different architectures. The header contains a version number
+ * and a byte order mark which are checked when reading.
+ */
+namespace snapshot {
+
+    constexpr const char magic[] = "OSMCSNAP"; // NOLINT(cppcoreguidelines-avoid-c-arrays, hicpp-avoid-c-arrays, modernize-avoid-c-arrays)
+    constexpr const uint32_t version = 2;
+    constexpr const uint32_t byte_order_mark = 0x01020304U;
+
+} // namespace snapshot
+
+/**
+ * Writes a snapshot file. The data is buffered and written out in larger
+ * chunks.
+ */
+class SnapshotWriter {
+
+    std::string m_filename;
+    std::string m_buffer;
+    int m_fd;
+
+    void flush();
+
+public:
+
+    /// Create the snapshot file and write the header.
+    explicit SnapshotWriter(const std::string& filename);
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    SnapshotWriter(SnapshotWriter&&) = delete;
+    SnapshotWriter& operator=(SnapshotWriter&&) = delete;
+
+    ~SnapshotWriter() noexcept;
+
+    void write(const void* data, std::size_t size);
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+        write(&value, sizeof(T));
+    }
+
+    /// Flush all data and close the file. Throws on write errors.
+    void close();
+
+}; // class SnapshotWriter
+
+/**
+ * Reads a snapshot file. The file is memory mapped and the data is read
+ * sequentially from the mapping.
+ */
+class SnapshotReader {
+
+    std::string m_filename;
+    FileDescriptor m_fd;
+    osmium::util::MemoryMapping m_mapping;
+    std::size_t m_pos = 0;
+
+public:
+
+    /// Open and map the snapshot file and check the header.
+    explicit SnapshotReader(const std::string& filename);
+
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    SnapshotReader(SnapshotReader&&) = delete;
+    SnapshotReader& operator=(SnapshotReader&&) = delete;
+
+    ~SnapshotReader() noexcept = default;
+
+    /**
+     * Return pointer to the next size bytes in the file and move forward.
+     * The data is not necessarily aligned. Throws if the file is too short.
+     */
+    const char* read(std::size_t size);
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+        T value;
+        std::memcpy(&value, read(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    /// Number of bytes not read yet.
+    std::size_t remaining() const noexcept {
+        return m_mapping.size() - m_pos;
+    }
+
+    /// Has all data been read?
+    bool eof() const noexcept {
+        return m_pos == m_mapping.size();
+    }
+
+    const std::string& filename() const noexcept {
+        return m_filename;
+    }
+
+}; // class SnapshotReader
+
+#endif // SNAPSHOT_HPP
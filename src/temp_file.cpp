@@ -0,0 +1,79 @@
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "temp_file.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifndef _MSC_VER
+# include <unistd.h>
+#endif
+
+std::string default_temp_dir(const std::string& filename) {
+    const char* tmpdir = std::getenv("TMPDIR"); // NOLINT(concurrency-mt-unsafe)
+    if (tmpdir && *tmpdir) {
+        return tmpdir;
+    }
+
+    const auto pos = filename.find_last_of('/');
+    if (pos == std::string::npos) {
+        return ".";
+    }
+    if (pos == 0) {
+        return "/";
+    }
+    return filename.substr(0, pos);
+}
+
+std::FILE* create_temp_file(const std::string& dir) {
+#ifndef _MSC_VER
+    std::string name{dir};
+    name += "/osmcoastline-XXXXXX";
+    std::vector<char> buffer(name.begin(), name.end());
+    buffer.push_back('\0');
+
+    const int fd = ::mkstemp(buffer.data());
+    if (fd == -1) {
+        throw std::system_error{errno, std::system_category(), "Creating temporary file in '" + dir + "' failed"};
+    }
+    ::unlink(buffer.data());
+
+    std::FILE* file = ::fdopen(fd, "w+b");
+    if (!file) {
+        const int err = errno;
+        ::close(fd);
+        throw std::system_error{err, std::system_category(), "Creating temporary file in '" + dir + "' failed"};
+    }
+    return file;
+#else
+    // There is no mkstemp() on Windows, so the directory is ignored here.
+    std::FILE* file = std::tmpfile();
+    if (!file) {
+        throw std::system_error{errno, std::system_category(), "Creating temporary file failed"};
+    }
+    return file;
+#endif
+}
@@ -0,0 +1,43 @@
+#ifndef TEMP_FILE_HPP
+#define TEMP_FILE_HPP
+
+/*
+
+  Copyright 2012-2026 Jochen Topf <jochen@topf.org>.
+
+  This file is part of OSMCoastline.
+
+  OSMCoastline is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  OSMCoastline is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with OSMCoastline.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <cstdio>
+#include <string>
+
+/**
+ * Get the default directory for temporary files: The directory in the
+ * TMPDIR environment variable if it is set, otherwise the directory the
+ * given file is in.
+ */
+std::string default_temp_dir(const std::string& filename);
+
+/**
+ * Create a temporary file in the given directory and open it for reading
+ * and writing. The file is removed right away, so it goes away when it is
+ * closed or the program ends. Throws std::system_error if the file can not
+ * be created.
+ */
+std::FILE* create_temp_file(const std::string& dir);
+
+#endif // TEMP_FILE_HPP
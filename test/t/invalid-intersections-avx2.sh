@@ -0,0 +1,123 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Intersections between many overlapping islands, so that segments are
+#  tested against batches of more than four others. There are crossing,
+#  touching, collinear overlapping, and disjoint segments. A long thin
+#  island reaching nearly around the world has segments too long for the
+#  AVX2 code, so it falls back to the scalar code for them. The check is
+#  run once as usual (with AVX2 if the CPU has it) and once without AVX2.
+#  Both runs must find the same errors in the same order.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+readonly DUMP_SCALAR=${BIN_DIR}/test/${TEST_ID}-${SRID}-scalar.dump
+
+#-----------------------------------------------------------------------------
+
+# Islands at x = 10 overlapping each other (w200 to w204), one with an edge
+# on the bottom edge of w200 (w205), one with a node on it (w206), and one
+# not touching anything (w207). A long island from x = -179.5 to 179.5 (w210)
+# with small islands crossing it near the antimeridian (w211 to w213).
+cat <<'OSM' >"$INPUT"
+n100 v1 x10.00 y20.00
+n101 v1 x10.10 y20.00
+n102 v1 x10.10 y20.10
+n103 v1 x10.00 y20.10
+n110 v1 x10.02 y20.03
+n111 v1 x10.12 y20.03
+n112 v1 x10.12 y20.13
+n113 v1 x10.02 y20.13
+n120 v1 x10.04 y20.01
+n121 v1 x10.14 y20.01
+n122 v1 x10.14 y20.11
+n123 v1 x10.04 y20.11
+n130 v1 x10.06 y20.05
+n131 v1 x10.16 y20.05
+n132 v1 x10.16 y20.15
+n133 v1 x10.06 y20.15
+n140 v1 x10.08 y20.02
+n141 v1 x10.18 y20.02
+n142 v1 x10.18 y20.12
+n143 v1 x10.08 y20.12
+n150 v1 x10.03 y19.90
+n151 v1 x10.07 y19.90
+n152 v1 x10.07 y20.00
+n153 v1 x10.03 y20.00
+n160 v1 x10.09 y19.98
+n161 v1 x10.10 y19.99
+n162 v1 x10.09 y20.00
+n163 v1 x10.08 y19.99
+n170 v1 x10.30 y20.30
+n171 v1 x10.35 y20.30
+n172 v1 x10.35 y20.35
+n173 v1 x10.30 y20.35
+n200 v1 x-179.50 y10.00
+n201 v1 x179.50 y10.00
+n202 v1 x179.50 y10.10
+n203 v1 x-179.50 y10.10
+n210 v1 x179.40 y9.95
+n211 v1 x179.45 y9.95
+n212 v1 x179.45 y10.05
+n213 v1 x179.40 y10.05
+n220 v1 x-179.45 y10.05
+n221 v1 x-179.40 y10.05
+n222 v1 x-179.40 y10.15
+n223 v1 x-179.45 y10.15
+n230 v1 x179.45 y10.02
+n231 v1 x179.55 y10.02
+n232 v1 x179.55 y10.04
+n233 v1 x179.45 y10.04
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+w201 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+w202 v1 Tnatural=coastline Nn120,n121,n122,n123,n120
+w203 v1 Tnatural=coastline Nn130,n131,n132,n133,n130
+w204 v1 Tnatural=coastline Nn140,n141,n142,n143,n140
+w205 v1 Tnatural=coastline Nn150,n151,n152,n153,n150
+w206 v1 Tnatural=coastline Nn160,n161,n162,n163,n160
+w207 v1 Tnatural=coastline Nn170,n171,n172,n173,n170
+w210 v1 Tnatural=coastline Nn200,n201,n202,n203,n200
+w211 v1 Tnatural=coastline Nn210,n211,n212,n213,n210
+w212 v1 Tnatural=coastline Nn220,n221,n222,n223,n220
+w213 v1 Tnatural=coastline Nn230,n231,n232,n233,n230
+OSM
+
+#-----------------------------------------------------------------------------
+
+dump_errors() {
+    echo "SELECT AsText(geometry), osm_id, error FROM error_points;" | $SQL
+    echo "SELECT AsText(geometry), osm_id, error FROM error_lines;" | $SQL
+    echo "SELECT count(*) FROM land_polygons;" | $SQL
+}
+
+set +e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" "$INPUT" >"$LOG" 2>&1
+RC=$?
+set -e
+
+check_count_with_op "error_points WHERE error = 'intersection'" -gt 0;
+
+dump_errors >"$DUMP"
+
+set +e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --no-avx2 "$INPUT" >"$LOG" 2>&1
+RC_SCALAR=$?
+set -e
+
+test $RC -eq $RC_SCALAR
+
+grep 'Not using AVX2 instructions' "$LOG"
+
+dump_errors >"$DUMP_SCALAR"
+
+cmp "$DUMP" "$DUMP_SCALAR"
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,91 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Intersections and overlaps between small islands. The intersection check
+#  is run once with all segments in memory and once with at most 4 segments
+#  in memory, so the segments are sorted in runs written to temporary files.
+#  Both runs must find the same errors. The temporary files must not be left
+#  behind in the temporary directory.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+readonly DUMP_SPILLED=${BIN_DIR}/test/${TEST_ID}-${SRID}-spilled.dump
+readonly TEMP_DIR=${BIN_DIR}/test/${TEST_ID}-${SRID}-tmp
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.00 y1.00
+n101 v1 x1.10 y1.00
+n102 v1 x1.10 y1.02
+n103 v1 x1.00 y1.02
+n110 v1 x1.05 y1.01
+n111 v1 x1.07 y1.01
+n112 v1 x1.07 y1.03
+n113 v1 x1.05 y1.03
+n120 v1 x1.02 y1.04
+n121 v1 x1.04 y1.06
+n122 v1 x1.04 y1.04
+n123 v1 x1.02 y1.06
+n130 v1 x1.01 y1.05
+n131 v1 x1.09 y1.05
+n132 v1 x1.09 y1.07
+n133 v1 x1.01 y1.07
+n140 v1 x1.10 y1.00
+n141 v1 x1.10 y1.02
+n142 v1 x1.12 y1.02
+n143 v1 x1.12 y1.00
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+w201 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+w202 v1 Tnatural=coastline Nn120,n121,n122,n123,n120
+w203 v1 Tnatural=coastline Nn130,n131,n132,n133,n130
+w204 v1 Tnatural=coastline Nn140,n143,n142,n141,n140
+OSM
+
+#-----------------------------------------------------------------------------
+
+# The order of the errors is not part of the comparison, only which errors
+# are found.
+dump_errors() {
+    echo "SELECT AsText(geometry), osm_id, error FROM error_points ORDER BY 1, 2, 3;" | $SQL
+    echo "SELECT AsText(geometry), osm_id, error FROM error_lines ORDER BY 1, 2, 3;" | $SQL
+}
+
+set +e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" "$INPUT" >"$LOG" 2>&1
+RC=$?
+set -e
+
+check_count_with_op error_points -gt 0;
+check_count_with_op error_lines -gt 0;
+
+dump_errors >"$DUMP"
+
+rm -fr "$TEMP_DIR"
+mkdir "$TEMP_DIR"
+
+set +e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --max-memory-segments=4 --temp-dir="$TEMP_DIR" "$INPUT" >"$LOG" 2>&1
+RC_SPILLED=$?
+set -e
+
+test $RC -eq $RC_SPILLED
+
+grep -q "Keeping at most 4 segments in memory" "$LOG"
+grep -q "Temporary files are written to '$TEMP_DIR'" "$LOG"
+
+test -z "$(ls -A "$TEMP_DIR")"
+
+dump_errors >"$DUMP_SPILLED"
+
+cmp "$DUMP" "$DUMP_SPILLED"
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,61 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  A ring going out to a node and back along the same segment. The
+#  duplicate segment is reported as overlap and the ring is not marked as
+#  valid. So its polygon is checked with IsValid() and repaired with
+#  Buffer(0), which removes the spike.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.01 y1.01
+n101 v1 x1.05 y1.01
+n102 v1 x1.05 y1.05
+n103 v1 x1.07 y1.07
+n104 v1 x1.01 y1.05
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n102,n104,n100
+OSM
+
+#-----------------------------------------------------------------------------
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" "$INPUT" >"$LOG" 2>&1
+RC=$?
+set -e
+
+test $RC -eq 1
+
+grep 'Turned 0 polygons around.$' "$LOG"
+
+# Whether the repaired ring is found as "questionable" depends on the first
+# point of the polygon created by Buffer(0).
+if [ "$SRID" = "4326" ]; then
+    QUESTIONABLE=$(sed -n -e 's/^  Found \([0-9]*\) rings in input data.$/\1/p' "$LOG")
+else
+    QUESTIONABLE=0
+fi
+
+grep "^There were $((1 + QUESTIONABLE)) warnings.$" "$LOG"
+grep '^There were 0 errors.$' "$LOG"
+
+check_count land_polygons 1;
+check_count error_points 0;
+check_count "error_lines WHERE error = 'overlap'" 1;
+check_count "error_lines WHERE error = 'questionable'" "$QUESTIONABLE";
+
+echo "SELECT InsertEpsgSrid(4326);" | $SQL
+
+echo "SELECT AsText(Transform(geometry, 4326)), osm_id, error FROM error_lines WHERE error = 'overlap';" | $SQL \
+    | grep -F 'LINESTRING(1.05 1.05, 1.07 1.07)|0|overlap'
+
+# The spike is gone, only the four corners are left.
+check_count "land_polygons WHERE IsValid(geometry) AND NumPoints(ExteriorRing(geometry)) = 5" 1;
+
+#-----------------------------------------------------------------------------
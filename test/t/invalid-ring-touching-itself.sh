@@ -0,0 +1,65 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  A ring touching itself in one node next to a valid island. The
+#  intersection check doesn't report this, but it must not mark the ring
+#  as valid either. So its polygon is checked with IsValid(), Buffer(0) is
+#  tried, and because that creates two polygons, the ring is ignored. The
+#  island is known to be valid and not checked again.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.01 y1.01
+n101 v1 x1.03 y1.01
+n102 v1 x1.03 y1.03
+n103 v1 x1.05 y1.03
+n104 v1 x1.05 y1.05
+n105 v1 x1.01 y1.03
+n106 v1 x1.03 y1.05
+n110 v1 x1.11 y1.01
+n111 v1 x1.13 y1.01
+n112 v1 x1.13 y1.03
+n113 v1 x1.11 y1.03
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n104,n106,n102,n105,n100
+w201 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+OSM
+
+#-----------------------------------------------------------------------------
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" "$INPUT" >"$LOG" 2>&1
+RC=$?
+set -e
+
+grep 'Ignoring invalid polygon geometry (ring_id=200)' "$LOG"
+
+if [ "$SRID" = "4326" ]; then
+    # The ignored ring is reported as "questionable"
+    test $RC -eq 1
+    grep '^There were 1 warnings.$' "$LOG"
+    check_count error_lines 1;
+else
+    # "questionables" are not checked in 3857
+    test $RC -eq 0
+    grep '^There were 0 warnings.$' "$LOG"
+    check_count error_lines 0;
+fi
+
+grep '^There were 0 errors.$' "$LOG"
+
+check_count land_polygons 1;
+check_count error_points 0;
+
+echo "SELECT InsertEpsgSrid(4326);" | $SQL
+
+echo "SELECT AsText(Transform(geometry, 4326)) FROM land_polygons;" | $SQL \
+    | grep -F 'POLYGON((1.11 1.01, 1.11 1.03, 1.13 1.03, 1.13 1.01, 1.11 1.01))'
+
+#-----------------------------------------------------------------------------
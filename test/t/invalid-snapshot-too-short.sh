@@ -0,0 +1,32 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Snapshot files shorter than the header are rejected.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+readonly SNAPSHOT=${BIN_DIR}/test/${TEST_ID}-${SRID}.snapshot
+
+#-----------------------------------------------------------------------------
+
+printf 'OSMC' >"$SNAPSHOT"
+
+#-----------------------------------------------------------------------------
+
+set +e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --read-snapshot="$SNAPSHOT" >"$LOG" 2>&1
+RC=$?
+set -e
+
+test $RC -eq 3
+
+grep "is not an osmcoastline snapshot file" "$LOG"
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,56 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid coastline with a lake touching the outer coastline in one node.
+#  This is a valid polygon with a hole touching its outer ring.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.01 y1.01
+n101 v1 x1.11 y1.01
+n102 v1 x1.11 y1.11
+n103 v1 x1.01 y1.11
+n110 v1 x1.05 y1.03
+n111 v1 x1.05 y1.07
+n112 v1 x1.09 y1.07
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+w201 v1 Tnatural=coastline Nn110,n111,n112,n101,n110
+OSM
+
+#-----------------------------------------------------------------------------
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" "$INPUT" >"$LOG" 2>&1
+RC=$?
+set -e
+
+if [ "$SRID" = "4326" ]; then
+    # The lake is reported as "questionable"
+    test $RC -eq 1
+    grep '^There were 1 warnings.$' "$LOG"
+    check_count error_lines 1;
+else
+    # "questionables" are not checked in 3857
+    test $RC -eq 0
+    grep '^There were 0 warnings.$' "$LOG"
+    check_count error_lines 0;
+fi
+
+grep '^There were 0 errors.$' "$LOG"
+
+check_count land_polygons 1;
+check_count error_points 0;
+
+echo "SELECT InsertEpsgSrid(4326);" | $SQL
+
+echo "SELECT AsText(Transform(geometry, 4326)) FROM land_polygons;" | $SQL \
+    | grep -F 'POLYGON((1.01 1.01, 1.01 1.11, 1.11 1.11, 1.11 1.01, 1.01 1.01), (1.05 1.03, 1.11 1.01, 1.09 1.07, 1.05 1.07, 1.05 1.03))'
+
+#-----------------------------------------------------------------------------
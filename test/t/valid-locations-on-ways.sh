@@ -0,0 +1,44 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid small "island" from two ways with node locations on the ways and
+#  no nodes in the input file.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+w200 v1 Tnatural=coastline Nn100x1.01y1.01,n101x1.02y1.01,n102x1.03y1.02
+w201 v1 Tnatural=coastline Nn102x1.03y1.02,n103x1.04y1.02,n104x1.05y1.03,n105x1.01y1.03,n100x1.01y1.01
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" "$INPUT" >"$LOG" 2>&1
+
+test $? -eq 0
+
+grep 'All node locations are on the ways, no need to read nodes' "$LOG"
+grep 'All locations are there.$' "$LOG"
+
+grep '^There were 0 warnings.$' "$LOG"
+grep '^There were 0 errors.$' "$LOG"
+
+check_count land_polygons 1;
+check_count error_points 0;
+check_count error_lines 0;
+
+echo "SELECT InsertEpsgSrid(4326);" | $SQL
+
+echo "SELECT AsText(Transform(geometry, 4326)) FROM land_polygons;" | $SQL \
+    | grep -F 'POLYGON((1.01 1.01, 1.01 1.03, 1.05 1.03, 1.04 1.02, 1.03 1.02, 1.02 1.01, 1.01 1.01))'
+
+#-----------------------------------------------------------------------------
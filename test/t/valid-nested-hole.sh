@@ -0,0 +1,70 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid coastline with a lake inside the land, an island in the lake, and
+#  a pond on the island. The pond must become a hole in the island, not in
+#  the larger land polygon around the lake.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.01 y1.01
+n101 v1 x1.11 y1.01
+n102 v1 x1.11 y1.11
+n103 v1 x1.01 y1.11
+n110 v1 x1.03 y1.03
+n111 v1 x1.03 y1.09
+n112 v1 x1.09 y1.09
+n113 v1 x1.09 y1.03
+n120 v1 x1.05 y1.05
+n121 v1 x1.07 y1.05
+n122 v1 x1.07 y1.07
+n123 v1 x1.05 y1.07
+n130 v1 x1.055 y1.055
+n131 v1 x1.055 y1.065
+n132 v1 x1.065 y1.065
+n133 v1 x1.065 y1.055
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+w201 v1 Tnatural=coastline Nn110,n111,n112,n113,n110
+w202 v1 Tnatural=coastline Nn120,n121,n122,n123,n120
+w203 v1 Tnatural=coastline Nn130,n131,n132,n133,n130
+OSM
+
+#-----------------------------------------------------------------------------
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" "$INPUT" >"$LOG" 2>&1
+RC=$?
+set -e
+
+if [ "$SRID" = "4326" ]; then
+    # The lake and the pond are reported as "questionable"
+    test $RC -eq 1
+    grep '^There were 2 warnings.$' "$LOG"
+    check_count error_lines 2;
+else
+    # "questionables" are not checked in 3857
+    test $RC -eq 0
+    grep '^There were 0 warnings.$' "$LOG"
+    check_count error_lines 0;
+fi
+
+grep '^There were 0 errors.$' "$LOG"
+
+check_count land_polygons 2;
+check_count error_points 0;
+
+echo "SELECT InsertEpsgSrid(4326);" | $SQL
+
+echo "SELECT AsText(Transform(geometry, 4326)) FROM land_polygons;" | $SQL >"$DUMP"
+
+grep -F 'POLYGON((1.01 1.01, 1.01 1.11, 1.11 1.11, 1.11 1.01, 1.01 1.01), (1.03 1.03, 1.09 1.03, 1.09 1.09, 1.03 1.09, 1.03 1.03))' "$DUMP"
+grep -F 'POLYGON((1.05 1.05, 1.05 1.07, 1.07 1.07, 1.07 1.05, 1.05 1.05), (1.055 1.055, 1.065 1.055, 1.065 1.065, 1.055 1.065, 1.055 1.055))' "$DUMP"
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,59 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  One node of a valid small "island" is moved east across a tile boundary
+#  at zoom level 10. The removed segments are in the tile of the island,
+#  the added segments go through that tile and the one east of it. The
+#  tiles are found with osmcoastline_segments.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+readonly OSMC_SEGMENTS=${BIN_DIR}/src/osmcoastline_segments
+readonly SEGMENTS1=${BIN_DIR}/test/${TEST_ID}-${SRID}-1.segments
+readonly SEGMENTS2=${BIN_DIR}/test/${TEST_ID}-${SRID}-2.segments
+readonly TILES=${BIN_DIR}/test/${TEST_ID}-${SRID}.tiles
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.01 y1.01
+n101 v1 x1.04 y1.01
+n102 v1 x1.04 y1.04
+n103 v1 x1.01 y1.04
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --write-segments="$SEGMENTS1" "$INPUT" >"$LOG" 2>&1
+
+# The tile boundary is at 1.0546875 degrees east in both tile grids.
+sed -i -e 's/^n102 v1 x1.04 y1.04$/n102 v1 x1.07 y1.04/' "$INPUT"
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --write-segments="$SEGMENTS2" "$INPUT" >"$LOG" 2>&1
+
+set +e
+"$OSMC_SEGMENTS" --zoom=10 --srs="$SRID" --tiles="$TILES" "$SEGMENTS1" "$SEGMENTS2"
+test $? -eq 1 || exit 1
+set -e
+
+# Two segments removed and two added in the tile of the island, the two
+# added segments also go through the tile east of it.
+if [ "$SRID" = 4326 ]; then
+    test "$(cat "$TILES")" = "10/1029/506 2 2
+10/1030/506 0 2"
+else
+    test "$(cat "$TILES")" = "10/514/509 2 2
+10/515/509 0 2"
+fi
+
+#-----------------------------------------------------------------------------
@@ -0,0 +1,55 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid small "island" with negative node IDs read in a single pass.
+#
+#  The nodes are not ordered by ID, so the index for negative IDs must be
+#  sorted before the locations can be looked up.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n-105 v1 x1.01 y1.03
+n-100 v1 x1.01 y1.01
+n-104 v1 x1.05 y1.03
+n-101 v1 x1.02 y1.01
+n-103 v1 x1.04 y1.02
+n-102 v1 x1.03 y1.02
+w-200 v1 Tnatural=coastline Nn-100,n-101,n-102
+w-201 v1 Tnatural=coastline Nn-102,n-103,n-104,n-105,n-100
+OSM
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --single-pass --input-format=opl - <"$INPUT" >"$LOG" 2>&1
+
+test $? -eq 0
+
+grep 'single pass through input file' "$LOG"
+grep 'All locations are there.$' "$LOG"
+
+grep '^There were 0 warnings.$' "$LOG"
+grep '^There were 0 errors.$' "$LOG"
+
+test ! -e "${DB}.locations"
+
+check_count land_polygons 1;
+check_count error_points 0;
+check_count error_lines 0;
+
+echo "SELECT InsertEpsgSrid(4326);" | $SQL
+
+echo "SELECT AsText(Transform(geometry, 4326)) FROM land_polygons;" | $SQL \
+    | grep -F 'POLYGON((1.01 1.01, 1.01 1.03, 1.05 1.03, 1.04 1.02, 1.03 1.02, 1.02 1.01, 1.01 1.01))'
+
+#-----------------------------------------------------------------------------
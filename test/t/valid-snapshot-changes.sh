@@ -0,0 +1,81 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Valid small "island" from two ways written to a snapshot file. A change
+#  file moving a node and removing a node from one of the ways is then
+#  applied to the snapshot.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+readonly SNAPSHOT=${BIN_DIR}/test/${TEST_ID}-${SRID}.snapshot
+readonly CHANGES=${BIN_DIR}/test/${TEST_ID}-${SRID}.osc
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.01 y1.01
+n101 v1 x1.02 y1.01
+n102 v1 x1.03 y1.02
+n103 v1 x1.04 y1.02
+n104 v1 x1.05 y1.03
+n105 v1 x1.01 y1.03
+w200 v1 Tnatural=coastline Nn100,n101,n102
+w201 v1 Tnatural=coastline Nn102,n103,n104,n105,n100
+OSM
+
+cat <<'OSC' >"$CHANGES"
+<?xml version="1.0" encoding="UTF-8"?>
+<osmChange version="0.6" generator="test">
+  <modify>
+    <node id="104" version="2" lat="1.03" lon="1.06"/>
+    <way id="201" version="2">
+      <nd ref="102"/>
+      <nd ref="104"/>
+      <nd ref="105"/>
+      <nd ref="100"/>
+      <tag k="natural" v="coastline"/>
+    </way>
+  </modify>
+  <delete>
+    <node id="103" version="2"/>
+  </delete>
+</osmChange>
+OSC
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+"$OSMC" --verbose --overwrite --srs=4326 --output-database="$DB" \
+    --write-snapshot="$SNAPSHOT" "$INPUT" >"$LOG" 2>&1
+
+test $? -eq 0
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --read-snapshot="$SNAPSHOT" --apply-changes="$CHANGES" >"$LOG" 2>&1
+
+test $? -eq 0
+
+grep 'Split 1 rings containing changed ways.$' "$LOG"
+grep 'Added 1 new or changed coastline ways.$' "$LOG"
+grep 'There are 1 coastline rings (0 from a single closed way and 1 others).$' "$LOG"
+grep 'All locations are there.$' "$LOG"
+
+grep '^There were 0 warnings.$' "$LOG"
+grep '^There were 0 errors.$' "$LOG"
+
+check_count land_polygons 1;
+check_count error_points 0;
+check_count error_lines 0;
+
+echo "SELECT InsertEpsgSrid(4326);" | $SQL
+
+echo "SELECT AsText(Transform(geometry, 4326)) FROM land_polygons;" | $SQL \
+    | grep -F 'POLYGON((1.01 1.01, 1.01 1.03, 1.06 1.03, 1.03 1.02, 1.02 1.01, 1.01 1.01))'
+
+#-----------------------------------------------------------------------------
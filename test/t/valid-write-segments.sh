@@ -0,0 +1,149 @@
+#!/bin/sh
+#-----------------------------------------------------------------------------
+#
+#  Segments of a valid small "island" are written to segment files which
+#  are then compared with osmcoastline_segments. The segments are also
+#  compared with a segment file in the old raw format. A larger island
+#  checks files with more than one block.
+#
+#-----------------------------------------------------------------------------
+
+# shellcheck source=test/init.sh
+. "$1/test/init.sh"
+
+set -x
+
+readonly OSMC_SEGMENTS=${BIN_DIR}/src/osmcoastline_segments
+readonly SEGMENTS1=${BIN_DIR}/test/${TEST_ID}-${SRID}-1.segments
+readonly SEGMENTS2=${BIN_DIR}/test/${TEST_ID}-${SRID}-2.segments
+readonly TEMP_DIR=${BIN_DIR}/test/${TEST_ID}-${SRID}-tmp
+readonly RAW_SEGMENTS=${BIN_DIR}/test/${TEST_ID}-${SRID}-raw.segments
+readonly INPUT_LARGE=${BIN_DIR}/test/${TEST_ID}-${SRID}-large.opl
+readonly SEGMENTS_LARGE1=${BIN_DIR}/test/${TEST_ID}-${SRID}-large-1.segments
+readonly SEGMENTS_LARGE2=${BIN_DIR}/test/${TEST_ID}-${SRID}-large-2.segments
+
+#-----------------------------------------------------------------------------
+
+cat <<'OSM' >"$INPUT"
+n100 v1 x1.01 y1.01
+n101 v1 x1.04 y1.01
+n102 v1 x1.04 y1.04
+n103 v1 x1.01 y1.04
+w200 v1 Tnatural=coastline Nn100,n101,n102,n103,n100
+OSM
+
+# Write a 32 bit integer in native byte order.
+write_int32() {
+    b0=$(($1 & 255))
+    b1=$((($1 >> 8) & 255))
+    b2=$((($1 >> 16) & 255))
+    b3=$((($1 >> 24) & 255))
+    if [ "$(printf '\001\000' | od -An -tu2 | tr -d ' ')" = "1" ]; then
+        # shellcheck disable=SC2059
+        printf "$(printf '\\%03o\\%03o\\%03o\\%03o' $b0 $b1 $b2 $b3)"
+    else
+        # shellcheck disable=SC2059
+        printf "$(printf '\\%03o\\%03o\\%03o\\%03o' $b3 $b2 $b1 $b0)"
+    fi
+}
+
+# Write a segment (x1 y1 x2 y2 in 1/10^7 degrees) in the old raw format.
+write_segment() {
+    write_int32 "$1"
+    write_int32 "$2"
+    write_int32 "$3"
+    write_int32 "$4"
+}
+
+#-----------------------------------------------------------------------------
+
+set -e
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --write-segments="$SEGMENTS1" "$INPUT" >"$LOG" 2>&1
+
+test $? -eq 0
+
+grep 'Writing segments to file' "$LOG"
+head -c 8 "$SEGMENTS1" | grep '^OSMCSEGS$'
+
+# Writing the segments again must give the same segments.
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --write-segments="$SEGMENTS2" "$INPUT" >"$LOG" 2>&1
+
+"$OSMC_SEGMENTS" "$SEGMENTS1" "$SEGMENTS2"
+
+# The same segments (sorted) in the old raw format without header and
+# compression.
+{
+    write_segment 10100000 10100000 10100000 10400000
+    write_segment 10100000 10100000 10400000 10100000
+    write_segment 10100000 10400000 10400000 10400000
+    write_segment 10400000 10100000 10400000 10400000
+} >"$RAW_SEGMENTS"
+
+test "$(wc -c <"$RAW_SEGMENTS")" -eq 64
+
+"$OSMC_SEGMENTS" "$RAW_SEGMENTS" "$SEGMENTS1"
+"$OSMC_SEGMENTS" "$SEGMENTS1" "$RAW_SEGMENTS"
+
+# Move one node, two segments are removed and two added.
+sed -i -e 's/^n102 v1 x1.04 y1.04$/n102 v1 x1.05 y1.05/' "$INPUT"
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --write-segments="$SEGMENTS2" "$INPUT" >"$LOG" 2>&1
+
+rm -fr "$TEMP_DIR"
+mkdir "$TEMP_DIR"
+
+set +e
+"$OSMC_SEGMENTS" --dump --temp-dir="$TEMP_DIR" "$SEGMENTS1" "$SEGMENTS2" >"$DUMP"
+test $? -eq 1 || exit 1
+set -e
+
+# The temporary file for the added segments is removed right away.
+test -z "$(ls -A "$TEMP_DIR")"
+
+test "$(sed -n -e '/^Removed:$/,/^Added:$/p' "$DUMP" | grep -c '^  ')" -eq 2
+test "$(sed -n -e '/^Added:$/,$p' "$DUMP" | grep -c '^  ')" -eq 2
+
+#-----------------------------------------------------------------------------
+
+# An island with 70002 segments, more than fit into one block. Its bottom
+# edge has 70000 nodes and is split into ways of 1000 nodes.
+awk 'BEGIN {
+    for (i = 0; i < 70000; ++i) {
+        printf "n%d v1 x%.5f y1.00000\n", 100000 + i, 1.0 + i * 0.00001
+    }
+    print "n200000 v1 x1.69999 y1.10000"
+    print "n200001 v1 x1.00000 y1.10000"
+    for (w = 0; w < 70; ++w) {
+        printf "w%d v1 Tnatural=coastline Nn%d", 300000 + w, 100000 + w * 1000
+        for (i = w * 1000 + 1; i <= w * 1000 + 1000 && i < 70000; ++i) {
+            printf ",n%d", 100000 + i
+        }
+        printf "\n"
+    }
+    print "w300070 v1 Tnatural=coastline Nn169999,n200000,n200001,n100000"
+}' >"$INPUT_LARGE"
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --write-segments="$SEGMENTS_LARGE1" "$INPUT_LARGE" >"$LOG" 2>&1
+
+"$OSMC_SEGMENTS" "$SEGMENTS_LARGE1" "$SEGMENTS_LARGE1"
+
+# Move a node whose segments are in the second block.
+sed -i -e 's/^n169000 v1 x1.69000 y1.00000$/n169000 v1 x1.69000 y1.00005/' "$INPUT_LARGE"
+
+"$OSMC" --verbose --overwrite --srs="$SRID" --output-database="$DB" \
+    --write-segments="$SEGMENTS_LARGE2" "$INPUT_LARGE" >"$LOG" 2>&1
+
+set +e
+"$OSMC_SEGMENTS" --dump "$SEGMENTS_LARGE1" "$SEGMENTS_LARGE2" >"$DUMP"
+test $? -eq 1 || exit 1
+set -e
+
+test "$(sed -n -e '/^Removed:$/,/^Added:$/p' "$DUMP" | grep -c '^  ')" -eq 2
+test "$(sed -n -e '/^Added:$/,$p' "$DUMP" | grep -c '^  ')" -eq 2
+
+#-----------------------------------------------------------------------------